@@ -0,0 +1,64 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	anytime_log.cpp
+ *	Log of every new best square of the runs, written as they are found
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#include <time.h>
+#include "anytime_log.h"
+
+AnytimeLog::AnytimeLog(const char *param_path) {
+
+	start_time = getWallTime();
+
+	file = fopen(param_path, "a");
+	if(!file)
+		return;
+
+	//A new log starts with the header, later jobs append below it
+	fseek(file, 0, SEEK_END);
+	if(ftell(file) == 0) {
+		fprintf(file, "time,elapsed,seed,run,n,retention,square\n");
+		fflush(file);
+	}
+
+}
+
+AnytimeLog::~AnytimeLog() {
+
+	if(file)
+		fclose(file);
+
+}
+
+void AnytimeLog::record(unsigned long long param_seed, int param_run, int param_n, int param_retention, const int *param_square) {
+
+	if(!file)
+		return;
+
+	int nn = param_n * param_n;
+
+	mutex.lock();
+
+	fprintf(file, "%lld,%.3f,%llu,%d,%d,%d,", (long long)time(0), getWallTime() - start_time, param_seed, param_run, param_n, param_retention);
+	for(int i = 0; i < nn; ++i)
+		fprintf(file, i > 0 ? " %d" : "%d", param_square[i]);
+	fprintf(file, "\n");
+	fflush(file);
+
+	mutex.unlock();
+
+}
@@ -0,0 +1,50 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	anytime_log.h
+ *	Log of every new best square of the runs, written as they are found
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#ifndef _ANYTIME_LOG_H_
+#define _ANYTIME_LOG_H_
+
+#include <stdio.h>
+#include "threads.h"
+
+/**
+ *	Appends one CSV line per record to a file and flushes it, so the
+ *	best squares found so far survive a run which is killed. A line
+ *	holds the time, the seconds since the log was opened, the seed and
+ *	the run, the dimension, the retention and the square. Records of
+ *	concurrent runs are serialized by the log.
+ */
+
+class AnytimeLog {
+public:
+	AnytimeLog(const char *param_path);
+	~AnytimeLog();
+
+	bool isOpen() { return file != 0; }
+
+	void record(unsigned long long param_seed, int param_run, int param_n, int param_retention, const int *param_square);
+
+protected:
+	FILE *file;
+	double start_time;
+
+	Mutex mutex;
+};
+
+#endif
@@ -0,0 +1,136 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	checkpoint.cpp
+ *	Binary checkpoint files which are replaced atomically
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#include "checkpoint.h"
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+CheckpointWriter::CheckpointWriter(const char *param_path) {
+
+	path = param_path;
+	tmp_path = path + ".tmp";
+
+	file = fopen(tmp_path.c_str(), "wb");
+	failed = (file == 0);
+
+	int magic = CHECKPOINT_MAGIC;
+	int version = CHECKPOINT_VERSION;
+	put(magic);
+	put(version);
+
+}
+
+CheckpointWriter::~CheckpointWriter() {
+
+	//Not committed, drop the partial file
+	if(file) {
+		fclose(file);
+		remove(tmp_path.c_str());
+	}
+
+}
+
+void CheckpointWriter::write(const void *param_data, size_t param_bytes) {
+
+	if(failed)
+		return;
+
+	if(fwrite(param_data, 1, param_bytes, file) != param_bytes)
+		failed = true;
+
+}
+
+bool CheckpointWriter::commit() {
+
+	if(!file)
+		return false;
+
+	//The data has to be on disk before the rename is
+	if(fflush(file) != 0)
+		failed = true;
+
+#ifdef WIN32
+	if(!failed && _commit(_fileno(file)) != 0)
+		failed = true;
+#else
+	if(!failed && fsync(fileno(file)) != 0)
+		failed = true;
+#endif
+
+	if(fclose(file) != 0)
+		failed = true;
+	file = 0;
+
+	if(!failed) {
+#ifdef WIN32
+		if(!MoveFileExA(tmp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+			failed = true;
+#else
+		if(rename(tmp_path.c_str(), path.c_str()) != 0)
+			failed = true;
+#endif
+	}
+
+	if(failed)
+		remove(tmp_path.c_str());
+
+	return !failed;
+
+}
+
+CheckpointReader::CheckpointReader(const char *param_path) {
+
+	failed = false;
+	file = fopen(param_path, "rb");
+	if(!file)
+		return;
+
+	int magic = 0;
+	int version = 0;
+	if(!get(magic) || !get(version) || magic != CHECKPOINT_MAGIC || version != CHECKPOINT_VERSION) {
+		fclose(file);
+		file = 0;
+	}
+
+}
+
+CheckpointReader::~CheckpointReader() {
+
+	if(file)
+		fclose(file);
+
+}
+
+bool CheckpointReader::read(void *param_data, size_t param_bytes) {
+
+	if(!file || failed)
+		return false;
+
+	if(fread(param_data, 1, param_bytes, file) != param_bytes)
+		failed = true;
+
+	return !failed;
+
+}
@@ -0,0 +1,78 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	checkpoint.h
+ *	Binary checkpoint files which are replaced atomically
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string>
+
+#define CHECKPOINT_MAGIC 0x534D5257 //"WRMS"
+#define CHECKPOINT_VERSION 6
+
+/**
+ *	Writes to <path>.tmp and on commit() flushes it to disk and renames
+ *	it over <path>, so a crash leaves either the old or the new
+ *	checkpoint. Values are written in the byte order of the machine,
+ *	a checkpoint is only read back by the build that wrote it.
+ */
+
+class CheckpointWriter {
+public:
+	CheckpointWriter(const char *param_path);
+	~CheckpointWriter();
+
+	void write(const void *param_data, size_t param_bytes);
+
+	template<class T>
+	void put(const T &param_value) { write(&param_value, sizeof(T)); }
+
+	//Returns false if anything failed, the old checkpoint is then kept
+	bool commit();
+
+protected:
+	std::string path;
+	std::string tmp_path;
+	FILE *file;
+	bool failed;
+};
+
+class CheckpointReader {
+public:
+	CheckpointReader(const char *param_path);
+	~CheckpointReader();
+
+	//False if the file is missing or not a checkpoint
+	bool isOpen() { return file != 0; }
+
+	//False once a read has failed or the file is not open
+	bool isValid() { return file != 0 && !failed; }
+
+	bool read(void *param_data, size_t param_bytes);
+
+	template<class T>
+	bool get(T &param_value) { return read(&param_value, sizeof(T)); }
+
+protected:
+	FILE *file;
+	bool failed;
+};
+
+#endif
@@ -0,0 +1,171 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	compound_moves.h
+ *	Compound moves of the searches, 3-cycles of cells and rotations of
+ *	row and column segments, sampled and scored in batches
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#ifndef _COMPOUND_MOVES_H_
+#define _COMPOUND_MOVES_H_
+
+//Moves per batch of the single move searches
+#define COMPOUND_BATCH_SIZE 32
+
+/**
+ *	A swap can only fix two violated lines by breaking others, a
+ *	compound move changes three or more cells at once. Every move is a
+ *	cycle of MSMatrix::cycleDelta(). A rotation moves the values of a
+ *	segment of 3 to n cells of a row one step along it, which keeps the
+ *	row sum and changes only the columns, or the other way round.
+ */
+
+enum CompoundMoveKind {
+	COMPOUND_CYCLE, //3-cycle of any three cells
+	COMPOUND_ROW_ROTATION,
+	COMPOUND_COLUMN_ROTATION,
+	COMPOUND_MOVE_KINDS
+};
+
+/**
+ *	Draws a random compound move into param_cells_out and returns its
+ *	number of cells, at most n or 3. The move contains a cell of the
+ *	param_conflict_count cells of param_conflict_cells if there are
+ *	any. Half of the moves are 3-cycles, the rest rotations of a
+ *	random direction, length and segment.
+ */
+
+template<class Matrix>
+int randomCompoundMove(Matrix *param_mat, const int *param_conflict_cells, int param_conflict_count, int *param_cells_out) {
+
+	int n = param_mat->getN();
+	int nn = n * n;
+
+	Random &random = param_mat->getRandom();
+
+	int anchor;
+	if(param_conflict_count > 0)
+		anchor = param_conflict_cells[random.nextInt(param_conflict_count)];
+	else
+		anchor = random.nextInt(nn);
+
+	int kind = COMPOUND_CYCLE;
+	if(n >= 3 && random.nextInt(2) == 0)
+		kind = random.nextInt(2) == 0 ? COMPOUND_ROW_ROTATION : COMPOUND_COLUMN_ROTATION;
+
+	if(kind == COMPOUND_CYCLE) {
+		int i2 = random.nextInt(nn - 1);
+		if(i2 >= anchor)
+			++i2;
+		int i3 = random.nextInt(nn - 2);
+		if(i3 >= (anchor < i2 ? anchor : i2))
+			++i3;
+		if(i3 >= (anchor < i2 ? i2 : anchor))
+			++i3;
+
+		param_cells_out[0] = anchor;
+		param_cells_out[1] = i2;
+		param_cells_out[2] = i3;
+		return 3;
+	}
+
+	//A segment of the row or column of the anchor which contains it
+	int length = 3 + random.nextInt(n - 2);
+	int line = kind == COMPOUND_ROW_ROTATION ? anchor / n : anchor % n;
+	int position = kind == COMPOUND_ROW_ROTATION ? anchor % n : anchor / n;
+
+	int first = position - length + 1;
+	if(first < 0)
+		first = 0;
+	int last = position < n - length ? position : n - length;
+	int start = first + random.nextInt(last - first + 1);
+
+	bool reverse = random.nextInt(2) == 0;
+
+	for(int k = 0; k < length; ++k) {
+		int p = start + (reverse ? length - 1 - k : k);
+		param_cells_out[k] = kind == COMPOUND_ROW_ROTATION ? line * n + p : p * n + line;
+	}
+
+	return length;
+
+}
+
+/**
+ *	Batch of compound moves, sampled together and scored by a single
+ *	MSMatrix::cycleDeltas() call which reads the line sums once.
+ */
+
+class CompoundBatch {
+public:
+	CompoundBatch(int param_n) : n(param_n), capacity(0), moves(0), cells(0), starts(0), deltas(0) {}
+
+	~CompoundBatch() {
+		if(cells) {
+			delete[] cells;
+			delete[] starts;
+			delete[] deltas;
+		}
+	}
+
+	int size() { return moves; }
+	const int *getCells(int param_move) { return cells + starts[param_move]; }
+	int getCellCount(int param_move) { return starts[param_move + 1] - starts[param_move]; }
+	int getViolationDelta(int param_move) { return deltas[param_move]; }
+
+	//Replaces the batch with param_moves moves of randomCompoundMove()
+	//and their violation deltas on param_mat
+	template<class Matrix>
+	void sample(Matrix *param_mat, const int *param_conflict_cells, int param_conflict_count, int param_moves) {
+
+		reserve(param_moves);
+
+		starts[0] = 0;
+		for(int m = 0; m < param_moves; ++m)
+			starts[m + 1] = starts[m] + randomCompoundMove(param_mat, param_conflict_cells, param_conflict_count, cells + starts[m]);
+		moves = param_moves;
+
+		param_mat->cycleDeltas(cells, starts, moves, deltas);
+
+	}
+
+protected:
+	void reserve(int param_moves) {
+		if(param_moves <= capacity)
+			return;
+		if(cells) {
+			delete[] cells;
+			delete[] starts;
+			delete[] deltas;
+		}
+		capacity = param_moves;
+		cells = new int[(size_t)capacity * (n > 3 ? n : 3)];
+		starts = new int[capacity + 1];
+		deltas = new int[capacity];
+	}
+
+	int n;
+	int capacity;
+	int moves;
+	int *cells;
+	int *starts; //Of the cells of each move, and the end of the last
+	int *deltas; //Violation delta of each move
+
+private:
+	CompoundBatch(const CompoundBatch &);
+	CompoundBatch &operator=(const CompoundBatch &);
+};
+
+#endif
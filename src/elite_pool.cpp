@@ -0,0 +1,139 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	elite_pool.cpp
+ *	Pool of the best magic squares found by the concurrent runs of an
+ *	island search
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#include <string.h>
+#include "elite_pool.h"
+
+ElitePool::ElitePool(int param_n, int param_capacity) {
+
+	nn = param_n * param_n;
+	capacity = param_capacity < 1 ? 1 : param_capacity;
+	used = 0;
+
+	squares = new int[capacity * nn];
+	retention = new int[capacity];
+
+}
+
+ElitePool::~ElitePool() {
+
+	delete[] squares;
+	delete[] retention;
+
+}
+
+int ElitePool::size() {
+
+	mutex.lock();
+	int ret = used;
+	mutex.unlock();
+
+	return ret;
+
+}
+
+int ElitePool::getBestRetention() {
+
+	mutex.lock();
+	int best = -1;
+	for(int i = 0; i < used; ++i) {
+		if(retention[i] > best)
+			best = retention[i];
+	}
+	mutex.unlock();
+
+	return best;
+
+}
+
+bool ElitePool::publish(const int *param_square, int param_retention) {
+
+	mutex.lock();
+
+	if(findSquare(param_square, param_retention) != -1) {
+		mutex.unlock();
+		return false;
+	}
+
+	int slot = used;
+
+	if(used == capacity) {
+		slot = worst();
+		if(retention[slot] >= param_retention) {
+			mutex.unlock();
+			return false;
+		}
+	} else {
+		++used;
+	}
+
+	memcpy(squares + slot * nn, param_square, nn * sizeof(int));
+	retention[slot] = param_retention;
+
+	mutex.unlock();
+
+	return true;
+
+}
+
+bool ElitePool::sample(Random &param_random, int *param_square_out, int *param_retention_out) {
+
+	mutex.lock();
+
+	if(used == 0) {
+		mutex.unlock();
+		return false;
+	}
+
+	int a = param_random.nextInt(used);
+	int b = param_random.nextInt(used);
+	int sel = retention[a] >= retention[b] ? a : b;
+
+	memcpy(param_square_out, squares + sel * nn, nn * sizeof(int));
+	(*param_retention_out) = retention[sel];
+
+	mutex.unlock();
+
+	return true;
+
+}
+
+int ElitePool::findSquare(const int *param_square, int param_retention) {
+
+	for(int i = 0; i < used; ++i) {
+		if(retention[i] == param_retention && memcmp(squares + i * nn, param_square, nn * sizeof(int)) == 0)
+			return i;
+	}
+
+	return -1;
+
+}
+
+int ElitePool::worst() {
+
+	int sel = 0;
+	for(int i = 1; i < used; ++i) {
+		if(retention[i] < retention[sel])
+			sel = i;
+	}
+
+	return sel;
+
+}
@@ -0,0 +1,63 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	elite_pool.h
+ *	Pool of the best magic squares found by the concurrent runs of an
+ *	island search
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#ifndef _ELITE_POOL_H_
+#define _ELITE_POOL_H_
+
+#include "threads.h"
+#include "random.h"
+
+/**
+ *	Holds up to capacity distinct squares with the highest retention
+ *	published so far. Every method locks the pool, so runs on several
+ *	threads can publish and sample concurrently.
+ */
+
+class ElitePool {
+public:
+	ElitePool(int param_n, int param_capacity);
+	~ElitePool();
+
+	int size();
+	int getBestRetention();
+
+	//Inserts the square unless it is already in the pool or worse
+	//than every square of a full pool, returns true if inserted
+	bool publish(const int *param_square, int param_retention);
+
+	//Copies an elite chosen by a binary tournament, returns false if
+	//the pool is empty
+	bool sample(Random &param_random, int *param_square_out, int *param_retention_out);
+
+protected:
+	int findSquare(const int *param_square, int param_retention);
+	int worst();
+
+	int nn;
+	int capacity;
+	int used;
+
+	int *squares; //nn values per elite
+	int *retention;
+
+	Mutex mutex;
+};
+
+#endif
@@ -0,0 +1,463 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	local_search.h
+ *	Single move searches of the solver, simulated annealing and late
+ *	acceptance hill climbing. Every step evaluates one random swap
+ *	instead of the whole neighbourhood scanned by tabuRetention(), so
+ *	a step costs O(1) swap deltas and the search makes far more moves
+ *	per second on large squares.
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#ifndef _LOCAL_SEARCH_H_
+#define _LOCAL_SEARCH_H_
+
+#include <iostream>
+#include <math.h>
+#include <string.h>
+#include "tabu_search.h"
+
+//Temperature at the end of an annealing run relative to its start
+#define ANNEALING_END_RATIO 0.001
+
+#define LATE_ACCEPTANCE_HISTORY 1000
+
+/**
+ *	Search algorithm of a run, selected per job
+ */
+
+enum SearchAlgorithm {
+	SEARCH_TABU, //tabuRetention()
+	SEARCH_ANNEALING, //localSearchRetention() with AnnealingAcceptance
+	SEARCH_LATE_ACCEPTANCE, //localSearchRetention() with LateAcceptance
+	SEARCH_ALGORITHMS
+};
+
+inline const char *searchName(int param_search) {
+
+	static const char *names[SEARCH_ALGORITHMS] = { "tabu", "sa", "lahc" };
+
+	return names[param_search];
+
+}
+
+//Returns -1 if param_name is not the name of a search algorithm
+inline int parseSearchName(const char *param_name) {
+
+	for(int i = 0; i < SEARCH_ALGORITHMS; ++i) {
+		if(strcmp(param_name, searchName(i)) == 0)
+			return i;
+	}
+
+	return -1;
+
+}
+
+/**
+ *	Cost of a square in the single move searches, the violation less
+ *	weight times the retention. The weight follows the schedule of
+ *	tabuRetention(), so the search is driven to feasible squares and
+ *	back to more water once it finds one.
+ */
+
+struct SearchCost {
+	int violation;
+	int retention;
+
+	double value(double param_weight) const { return (double)violation - param_weight * (double)retention; }
+};
+
+/**
+ *	Acceptance rule of localSearchRetention(). Before a step evaluates
+ *	its move the rule gives the largest increase of the cost it
+ *	accepts, so most moves are rejected by their retention bounds
+ *	alone. param_progress is the share of the budget of the run used
+ *	so far, in [0, 1].
+ */
+
+class AcceptanceRule {
+public:
+	virtual ~AcceptanceRule() {}
+
+	//Called at the start of a run and after every restart, param_scale
+	//is the mean cost increase of a sample of uphill moves
+	virtual void start(const SearchCost &param_cost, double param_scale) = 0;
+
+	virtual double threshold(const SearchCost &param_current, double param_weight, double param_progress, Random &param_random) = 0;
+
+	//Called after every step with the cost of the square it left
+	virtual void step(const SearchCost &) {}
+};
+
+/**
+ *	Simulated annealing. An uphill move of cost increase d is accepted
+ *	with probability exp(-d / T), the threshold -T ln(u) of a uniform
+ *	u in (0, 1] is exceeded with that probability. T cools geometrically with the
+ *	progress of the run from the uphill scale sampled at its start to
+ *	ANNEALING_END_RATIO of it. Restarts keep the schedule.
+ */
+
+class AnnealingAcceptance : public AcceptanceRule {
+public:
+	AnnealingAcceptance() : start_temperature(0.0) {}
+
+	void start(const SearchCost &, double param_scale) {
+		if(start_temperature <= 0.0)
+			start_temperature = param_scale;
+	}
+
+	double threshold(const SearchCost &, double, double param_progress, Random &param_random) {
+		double temperature = start_temperature * pow(ANNEALING_END_RATIO, param_progress);
+		return -temperature * log(1.0 - param_random.nextDouble());
+	}
+
+protected:
+	double start_temperature;
+};
+
+/**
+ *	Late acceptance hill climbing. A move is accepted if it is no worse
+ *	than the current square or than the square of length steps ago,
+ *	whose cost is then replaced by the cost after the step. The costs
+ *	are kept by their parts and valued at the current weight.
+ */
+
+class LateAcceptance : public AcceptanceRule {
+public:
+	LateAcceptance(int param_length) : length(param_length), next(0) { history = new SearchCost[length]; }
+	~LateAcceptance() { delete[] history; }
+
+	void start(const SearchCost &param_cost, double) {
+		for(int i = 0; i < length; ++i)
+			history[i] = param_cost;
+		next = 0;
+	}
+
+	double threshold(const SearchCost &param_current, double param_weight, double, Random &) {
+		double late = history[next].value(param_weight) - param_current.value(param_weight);
+		return late > 0.0 ? late : 0.0;
+	}
+
+	void step(const SearchCost &param_current) {
+		history[next] = param_current;
+		if(++next == length)
+			next = 0;
+	}
+
+protected:
+	SearchCost *history; //Cost after each of the last length steps
+	int length;
+	int next; //Oldest entry of the history
+
+private:
+	LateAcceptance(const LateAcceptance &);
+	LateAcceptance &operator=(const LateAcceptance &);
+};
+
+//Rule of a single move search, NULL for the tabu search
+inline AcceptanceRule *createAcceptanceRule(int param_search, int param_history_length) {
+
+	switch(param_search) {
+	case SEARCH_ANNEALING:
+		return new AnnealingAcceptance();
+	case SEARCH_LATE_ACCEPTANCE:
+		return new LateAcceptance(param_history_length > 0 ? param_history_length : LATE_ACCEPTANCE_HISTORY);
+	default:
+		return 0;
+	}
+
+}
+
+/**
+ *	Draws a random swap of two distinct cells, the first from the
+ *	param_conflict_count cells of param_conflict_cells if there are any
+ */
+
+template<class Matrix>
+void randomSwap(Matrix *param_mat, const int *param_conflict_cells, int param_conflict_count, int *param_index1_out, int *param_index2_out) {
+
+	int nn = param_mat->getN() * param_mat->getN();
+
+	int i1;
+	if(param_conflict_count > 0)
+		i1 = param_conflict_cells[param_mat->getRandom().nextInt(param_conflict_count)];
+	else
+		i1 = param_mat->getRandom().nextInt(nn);
+
+	int i2 = param_mat->getRandom().nextInt(nn - 1);
+	if(i2 >= i1)
+		++i2;
+
+	*param_index1_out = i1;
+	*param_index2_out = i2;
+
+}
+
+/**
+ *	Cost of the square after swapping param_index1 and param_index2,
+ *	needs the water levels of retentionMergeTree()
+ */
+
+template<class Matrix>
+SearchCost swapCost(Matrix *param_mat, const SearchCost &param_cost, int param_index1, int param_index2) {
+
+	SearchCost cost;
+	cost.violation = param_cost.violation + param_mat->swapDelta(param_index1, param_index2);
+	cost.retention = param_cost.retention + param_mat->swapRetentionDelta(param_index1, param_index2);
+
+	return cost;
+
+}
+
+/**
+ *	Mean cost increase of the uphill moves among n * n random swaps,
+ *	1 if none of them is uphill
+ */
+
+template<class Matrix>
+double sampleUphillScale(Matrix *param_mat, const SearchCost &param_cost, double param_weight) {
+
+	int nn = param_mat->getN() * param_mat->getN();
+
+	double sum = 0.0;
+	int count = 0;
+
+	for(int k = 0; k < nn; ++k) {
+		int i1, i2;
+		randomSwap(param_mat, (const int*)0, 0, &i1, &i2);
+		double delta = swapCost(param_mat, param_cost, i1, i2).value(param_weight) - param_cost.value(param_weight);
+		if(delta > 0.0) {
+			sum += delta;
+			++count;
+		}
+	}
+
+	return count > 0 ? sum / (double)count : 1.0;
+
+}
+
+/**
+ *	Keeps the square in param_best_mat if it is feasible and holds more
+ *	water than the best square so far
+ */
+
+template<class Matrix>
+void keepBest(Matrix *param_mat, const SearchCost &param_cost, int *param_best_retention, int *param_best_mat, const AnytimeSettings *param_anytime) {
+
+	if(param_cost.violation > 0 || param_cost.retention <= *param_best_retention)
+		return;
+
+	int n = param_mat->getN();
+	int nn = n * n;
+
+	for(int i = 0; i < nn; ++i)
+		param_best_mat[i] = param_mat->getValue(i);
+	*param_best_retention = param_cost.retention;
+
+	if(param_anytime && param_anytime->log)
+		param_anytime->log->record(param_anytime->seed, param_anytime->run, n, param_cost.retention, param_best_mat);
+
+}
+
+/**
+ *	Single move search for the retention, the acceptance rule decides
+ *	on one random swap per step. While the square violates the
+ *	constraints the first cell of the swap is a conflict cell.
+ *	- An iteration takes as many steps as the neighbourhood of
+ *	- tabuRetention() has swaps, n * n * (n * n - 1) / 2.
+ *	- The weight of the retention decays every n * n steps as it does
+ *	- every iteration of tabuRetention(), and is reset on a feasible
+ *	- square.
+ *	- Between iterations the run restarts by chance, with
+ *	- param_constructive_restarts at a constructed magic square, see
+ *	- MSMatrix::constructiveRestart().
+ *	- param_compound_ratio is the share of the steps which evaluate a
+ *	- compound move instead of a swap, see compound_moves.h. The moves
+ *	- are sampled in batches which are dropped when the square changes,
+ *	- and evaluated as moves of the matrix since they have no
+ *	- retention bounds.
+ *	- param_anytime is NULL unless the run has a deadline or a log,
+ *	- the progress of a run with a deadline is the larger of its share
+ *	- of the iterations and of the time.
+ *	- The best square is kept in the buffers of param_buffers.
+ */
+
+template<class Matrix>
+int localSearchRetention(Matrix *param_mat,
+	AcceptanceRule *param_rule,
+	int param_iterations,
+	int param_chance_of_random_restart,
+	bool param_terminate_on_first_solution,
+	bool param_constructive_restarts,
+	double param_compound_ratio,
+	const AnytimeSettings *param_anytime,
+	RetentionBuffers *param_buffers,
+	std::ostream &param_out) {
+
+	int n = param_mat->getN();
+	int nn = n * n;
+
+	long long neighbourhood = (long long)nn * (nn - 1) / 2;
+	long long steps = (long long)param_iterations * neighbourhood;
+	long long step = 0;
+	long long accepted = 0;
+	int restarts = 0;
+
+	int best_retention = -1;
+	int *best_mat = param_buffers->best_mat;
+
+	double deadline = param_anytime ? param_anytime->deadline : 0.0;
+	double time_start = getWallTime();
+	double time_progress = 0.0;
+
+	double weight = 0.5;
+
+	Random &random = param_mat->getRandom();
+
+	char *conflict = param_buffers->conflict;
+	int *conflict_cells = param_buffers->conflict_cells;
+	int *conflict_after = param_buffers->conflict_after;
+	int conflict_count = 0;
+	bool conflicts_valid = false;
+
+	CompoundBatch *compound_batch = 0;
+	if(param_compound_ratio > 0.0) {
+		if(!param_buffers->compound_batch)
+			param_buffers->compound_batch = new CompoundBatch(n);
+		compound_batch = param_buffers->compound_batch;
+	}
+	bool compound_valid = false;
+	int compound_next = 0;
+	long long compound_evaluated = 0;
+	long long compound_accepted = 0;
+
+	SearchCost cost;
+	cost.violation = param_mat->violation();
+	cost.retention = param_mat->retentionMergeTree();
+	param_rule->start(cost, sampleUphillScale(param_mat, cost, weight));
+	keepBest(param_mat, cost, &best_retention, best_mat, param_anytime);
+
+	while((cost.violation > 0 || !param_terminate_on_first_solution) && step < steps) {
+
+		if(step % nn == 0) {
+			if(deadline > 0.0) {
+				double time = getWallTime();
+				if(time >= deadline)
+					break;
+				time_progress = (time - time_start) / (deadline - time_start);
+			}
+
+			if(step > 0) {
+				weight *= 0.99;
+				if(weight < 0.0001)
+					weight = 0.5;
+			}
+		}
+
+		if(step > 0 && step % neighbourhood == 0) {
+			if(param_chance_of_random_restart > 0 && random.nextInt(param_chance_of_random_restart) == 0) {
+				restartSquare(param_mat, param_constructive_restarts);
+				cost.violation = param_mat->getStoredViolation();
+				cost.retention = param_mat->retentionMergeTree();
+				param_rule->start(cost, sampleUphillScale(param_mat, cost, weight));
+				keepBest(param_mat, cost, &best_retention, best_mat, param_anytime);
+				conflicts_valid = false;
+				compound_valid = false;
+				++restarts;
+			}
+		}
+
+		double progress = (double)step / (double)steps;
+		if(time_progress > progress)
+			progress = time_progress;
+
+		++step;
+
+		if(!conflicts_valid) {
+			conflict_count = cost.violation > 0 ? buildConflictLists(param_mat, conflict, conflict_cells, conflict_after) : 0;
+			conflicts_valid = true;
+		}
+
+		bool compound_step = compound_batch && random.nextDouble() < param_compound_ratio;
+
+		int i1 = 0;
+		int i2 = 0;
+		if(!compound_step) {
+			randomSwap(param_mat, conflict_cells, conflict_count, &i1, &i2);
+		} else if(!compound_valid || compound_next == compound_batch->size()) {
+			compound_batch->sample(param_mat, conflict_cells, conflict_count, COMPOUND_BATCH_SIZE);
+			compound_valid = true;
+			compound_next = 0;
+		}
+
+		double threshold = param_rule->threshold(cost, weight, progress, random);
+
+		bool accept = false;
+		if(compound_step) {
+			int violation_delta = compound_batch->getViolationDelta(compound_next);
+			param_mat->beginMove();
+			param_mat->applyCycle(compound_batch->getCells(compound_next), compound_batch->getCellCount(compound_next));
+			accept = (double)violation_delta - weight * (double)(param_mat->getMoveRetention() - cost.retention) <= threshold;
+			if(accept) {
+				param_mat->commitMove();
+				++compound_accepted;
+			} else
+				param_mat->rollbackMove();
+			++compound_next;
+			++compound_evaluated;
+		} else {
+			//The exact retention delta is only needed if the largest
+			//retention gain brings the move under the threshold
+			int violation_delta = param_mat->swapDelta(i1, i2);
+			int lower, upper;
+			param_mat->swapRetentionBounds(i1, i2, &lower, &upper);
+
+			if((double)violation_delta - weight * (double)upper <= threshold)
+				accept = (double)violation_delta - weight * (double)param_mat->swapRetentionDelta(i1, i2) <= threshold;
+			if(accept)
+				param_mat->doSwap(i1, i2);
+		}
+
+		if(accept) {
+			//The water levels of the new square are needed by the next delta
+			cost.violation = param_mat->getStoredViolation();
+			cost.retention = param_mat->retentionMergeTree();
+			conflicts_valid = false;
+			compound_valid = false;
+			++accepted;
+
+			if(cost.violation == 0) {
+				keepBest(param_mat, cost, &best_retention, best_mat, param_anytime);
+				weight = 0.5;
+			}
+		}
+
+		param_rule->step(cost);
+	}
+
+	param_out << "Steps: " << step << ", moves made: " << accepted << ", restarts: " << restarts << std::endl;
+	if(compound_batch)
+		param_out << "Compound move evaluations: " << compound_evaluated << ", moves made: " << compound_accepted << std::endl;
+
+	if(best_retention > -1) {
+		for(int i = 0; i < nn; ++i)
+			param_mat->setValue(i, best_mat[i]);
+	}
+
+	return best_retention;
+
+}
+
+#endif
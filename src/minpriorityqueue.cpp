@@ -1,141 +1,298 @@
-
-/**
- *	Water Retention on Magic Squares Solver
- *
- *	Author: Johan Öfverstedt
- *	Modified: July 2012
- *	Version 0.12a
- *
- *	minpriorityqueue.cpp
- *	Minimum Priority Queue Implementation
- *
- *	Project website:
- *	sourceforge.net/projects/wrmssolver
- *
- *	Based on thesis:
- *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
- *
- */
- 
-#include "minpriorityqueue.h"
-
-MinPriorityQueue::MinPriorityQueue(int param_capacity) {
-
-	capacity = param_capacity;
-	used = 0;
-
-	index_queue = new int[capacity];
-	value_queue = new int[capacity];
-
-}
-
-MinPriorityQueue::~MinPriorityQueue() {
-
-	if(index_queue)
-		delete[] index_queue;
-	if(value_queue)
-		delete[] value_queue;
-
-}
-
-#ifndef MINHEAP_QUEUE_IMPLEMENTATION
-
-void MinPriorityQueue::enqueue(int param_index, int param_value) {
-
-	int i = used - 1;
-	for(; i >= 0 && value_queue[i] < param_value; --i) {
-		index_queue[i+1] = index_queue[i];
-		value_queue[i+1] = value_queue[i];
-	}
-	index_queue[i+1] = param_index;
-	value_queue[i+1] = param_value;
-
-	++used;
-}
-
-bool MinPriorityQueue::dequeue(int *param_index_out, int *param_value_out) {
-	
-	if(used < 1)
-		return false;
-
-	--used;
-
-	(*param_index_out) = index_queue[used];
-	(*param_value_out) = value_queue[used];
-
-	return true;
-
-}
-
-#else
-
-
-void MinPriorityQueue::enqueue(int param_index, int param_value) {
-
-	index_queue[used] = param_index;
-	value_queue[used] = param_value;
-
-	int i = used;
-	int parent = ((i + 1) >> 1) - 1;
-	while(i > 0 && value_queue[parent] > param_value) {
-		int index_tmp = index_queue[i];
-		index_queue[i] = index_queue[parent];
-		index_queue[parent] = index_tmp;
-		int value_tmp = value_queue[i];
-		value_queue[i] = value_queue[parent];
-		value_queue[parent] = value_tmp;
-		
-		i = parent;
-		parent = ((i + 1) >> 1) - 1;
-	}
-
-	++used;
-
-}
-
-bool MinPriorityQueue::dequeue(int *param_index_out, int *param_value_out) {
-	
-	if(used < 1)
-		return false;
-
-	(*param_index_out) = index_queue[0];
-	(*param_value_out) = value_queue[0];
-
-	index_queue[0] = index_queue[used - 1];
-	value_queue[0] = value_queue[used - 1];
-
-	--used;
-
-	minheapify(0);
-
-	return true;
-
-}
-
-void MinPriorityQueue::minheapify(int param_index) {
-
-	int left = 2 * (param_index + 1) - 1;
-	int right = left + 1;
-
-//	int parent = ((param_index + 1) / 2) - 1;
-
-	int smallest_index = param_index;
-	if(left < used && value_queue[left] < value_queue[param_index])
-		smallest_index = left;
-	if(right < used && value_queue[right] < value_queue[smallest_index])
-		smallest_index = right;
-	if(smallest_index != param_index) {
-		int index_tmp = index_queue[param_index];
-		index_queue[param_index] = index_queue[smallest_index];
-		index_queue[smallest_index] = index_tmp;
-		int value_tmp = value_queue[param_index];
-		value_queue[param_index] = value_queue[smallest_index];
-		value_queue[smallest_index] = value_tmp;
-
-		minheapify(smallest_index);
-	}
-}
-
-
-#endif
-
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	minpriorityqueue.cpp
+ *	Minimum Priority Queue Implementation
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+ 
+#include "minpriorityqueue.h"
+
+/**
+ *	Sorted array implementation
+ */
+
+SortedArrayQueue::SortedArrayQueue(int param_capacity, int) {
+
+	capacity = param_capacity;
+	used = 0;
+
+	index_queue = new int[capacity];
+	value_queue = new int[capacity];
+
+}
+
+SortedArrayQueue::~SortedArrayQueue() {
+
+	if(index_queue)
+		delete[] index_queue;
+	if(value_queue)
+		delete[] value_queue;
+
+}
+
+void SortedArrayQueue::enqueue(int param_index, int param_value) {
+
+	if(used == capacity)
+		grow();
+
+	int i = used - 1;
+	for(; i >= 0 && value_queue[i] < param_value; --i) {
+		index_queue[i+1] = index_queue[i];
+		value_queue[i+1] = value_queue[i];
+	}
+	index_queue[i+1] = param_index;
+	value_queue[i+1] = param_value;
+
+	++used;
+}
+
+void SortedArrayQueue::grow() {
+
+	//Stale entries of cells whose level was lowered again stay in
+	//the queue, so the number of entries is not bounded by capacity.
+
+	int new_capacity = 2 * capacity;
+
+	int *new_index_queue = new int[new_capacity];
+	int *new_value_queue = new int[new_capacity];
+
+	for(int i = 0; i < used; ++i) {
+		new_index_queue[i] = index_queue[i];
+		new_value_queue[i] = value_queue[i];
+	}
+
+	delete[] index_queue;
+	delete[] value_queue;
+
+	index_queue = new_index_queue;
+	value_queue = new_value_queue;
+	capacity = new_capacity;
+
+}
+
+bool SortedArrayQueue::dequeue(int *param_index_out, int *param_value_out) {
+	
+	if(used < 1)
+		return false;
+
+	--used;
+
+	(*param_index_out) = index_queue[used];
+	(*param_value_out) = value_queue[used];
+
+	return true;
+
+}
+
+/**
+ *	Minheap implementation
+ */
+
+MinHeapQueue::MinHeapQueue(int param_capacity, int) {
+
+	capacity = param_capacity;
+	used = 0;
+
+	index_queue = new int[capacity];
+	value_queue = new int[capacity];
+
+}
+
+MinHeapQueue::~MinHeapQueue() {
+
+	if(index_queue)
+		delete[] index_queue;
+	if(value_queue)
+		delete[] value_queue;
+
+}
+
+void MinHeapQueue::enqueue(int param_index, int param_value) {
+
+	if(used == capacity)
+		grow();
+
+	index_queue[used] = param_index;
+	value_queue[used] = param_value;
+
+	int i = used;
+	int parent = ((i + 1) >> 1) - 1;
+	while(i > 0 && value_queue[parent] > param_value) {
+		int index_tmp = index_queue[i];
+		index_queue[i] = index_queue[parent];
+		index_queue[parent] = index_tmp;
+		int value_tmp = value_queue[i];
+		value_queue[i] = value_queue[parent];
+		value_queue[parent] = value_tmp;
+		
+		i = parent;
+		parent = ((i + 1) >> 1) - 1;
+	}
+
+	++used;
+
+}
+
+void MinHeapQueue::grow() {
+
+	//Stale entries of cells whose level was lowered again stay in
+	//the queue, so the number of entries is not bounded by capacity.
+
+	int new_capacity = 2 * capacity;
+
+	int *new_index_queue = new int[new_capacity];
+	int *new_value_queue = new int[new_capacity];
+
+	for(int i = 0; i < used; ++i) {
+		new_index_queue[i] = index_queue[i];
+		new_value_queue[i] = value_queue[i];
+	}
+
+	delete[] index_queue;
+	delete[] value_queue;
+
+	index_queue = new_index_queue;
+	value_queue = new_value_queue;
+	capacity = new_capacity;
+
+}
+
+bool MinHeapQueue::dequeue(int *param_index_out, int *param_value_out) {
+	
+	if(used < 1)
+		return false;
+
+	(*param_index_out) = index_queue[0];
+	(*param_value_out) = value_queue[0];
+
+	index_queue[0] = index_queue[used - 1];
+	value_queue[0] = value_queue[used - 1];
+
+	--used;
+
+	minheapify(0);
+
+	return true;
+
+}
+
+void MinHeapQueue::minheapify(int param_index) {
+
+	int left = 2 * (param_index + 1) - 1;
+	int right = left + 1;
+
+//	int parent = ((param_index + 1) / 2) - 1;
+
+	int smallest_index = param_index;
+	if(left < used && value_queue[left] < value_queue[param_index])
+		smallest_index = left;
+	if(right < used && value_queue[right] < value_queue[smallest_index])
+		smallest_index = right;
+	if(smallest_index != param_index) {
+		int index_tmp = index_queue[param_index];
+		index_queue[param_index] = index_queue[smallest_index];
+		index_queue[smallest_index] = index_tmp;
+		int value_tmp = value_queue[param_index];
+		value_queue[param_index] = value_queue[smallest_index];
+		value_queue[smallest_index] = value_tmp;
+
+		minheapify(smallest_index);
+	}
+}
+
+/**
+ *	Bucket implementation
+ */
+
+BucketQueue::BucketQueue(int param_capacity, int param_max_value) {
+
+	capacity = param_capacity;
+	max_value = param_max_value;
+	used = 0;
+	min_bucket = max_value + 1;
+
+	bucket_head = new int[max_value + 1];
+	bucket_of = new int[capacity];
+	next = new int[capacity];
+	prev = new int[capacity];
+
+	for(int i = 0; i <= max_value; ++i)
+		bucket_head[i] = -1;
+	for(int i = 0; i < capacity; ++i)
+		bucket_of[i] = -1;
+
+}
+
+BucketQueue::~BucketQueue() {
+
+	delete[] bucket_head;
+	delete[] bucket_of;
+	delete[] next;
+	delete[] prev;
+
+}
+
+void BucketQueue::enqueue(int param_index, int param_value) {
+
+	int old_value = bucket_of[param_index];
+
+	if(old_value >= 0) {
+		//Already queued, unlink from the old bucket
+		if(prev[param_index] >= 0)
+			next[prev[param_index]] = next[param_index];
+		else
+			bucket_head[old_value] = next[param_index];
+		if(next[param_index] >= 0)
+			prev[next[param_index]] = prev[param_index];
+	} else {
+		++used;
+	}
+
+	int head = bucket_head[param_value];
+	next[param_index] = head;
+	prev[param_index] = -1;
+	if(head >= 0)
+		prev[head] = param_index;
+	bucket_head[param_value] = param_index;
+	bucket_of[param_index] = param_value;
+
+	if(param_value < min_bucket)
+		min_bucket = param_value;
+
+}
+
+bool BucketQueue::dequeue(int *param_index_out, int *param_value_out) {
+
+	if(used < 1)
+		return false;
+
+	while(bucket_head[min_bucket] < 0)
+		++min_bucket;
+
+	int index = bucket_head[min_bucket];
+	int head = next[index];
+	bucket_head[min_bucket] = head;
+	if(head >= 0)
+		prev[head] = -1;
+	bucket_of[index] = -1;
+
+	--used;
+
+	(*param_index_out) = index;
+	(*param_value_out) = min_bucket;
+
+	return true;
+
+}
@@ -1,50 +1,120 @@
-
-/**
- *	Water Retention on Magic Squares Solver
- *
- *	Author: Johan Öfverstedt
- *	Modified: July 2012
- *	Version 0.12a
- *
- *	minpriorityqueue.h
- *	Minimum Priority Queue Implementation
- *
- *	Project website:
- *	sourceforge.net/projects/wrmssolver
- *
- *	Based on thesis:
- *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
- *
- */
- 
-#ifndef _MINPRIORITY_QUEUE_H_
-#define _MINPRIORITY_QUEUE_H_
-
-//Experiments indicate the more advanced minheap implementation
-//is actually slower.
-//#define MINHEAP_QUEUE_IMPLEMENTATION
-
-class MinPriorityQueue {
-public:
-	MinPriorityQueue(int param_capacity);
-	~MinPriorityQueue();
-
-	int size() { return used; }
-
-	void enqueue(int param_index, int param_value);
-	bool dequeue(int *param_index_out, int *param_value_out);
-
-
-#ifdef MINHEAP_QUEUE_IMPLEMENTATION
-	void minheapify(int param_index);
-#endif
-
-protected:
-	int capacity;
-	int used;
-
-	int *index_queue;
-	int *value_queue;
-};
-
-#endif
\ No newline at end of file
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	minpriorityqueue.h
+ *	Minimum Priority Queue Implementation
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+ 
+#ifndef _MINPRIORITY_QUEUE_H_
+#define _MINPRIORITY_QUEUE_H_
+
+//Selects the queue used by the water retention flood. The bucket
+//queue is the default since every key is an integer in [0, n^2] and
+//the flood never dequeues a key lower than the last one dequeued.
+//Experiments indicate the more advanced minheap implementation
+//is actually slower than the sorted array, the queue_* benchmarks of
+//wrms_benchmark compare all three on the flood.
+#define BUCKET_QUEUE_IMPLEMENTATION
+//#define MINHEAP_QUEUE_IMPLEMENTATION
+//#define SORTED_ARRAY_QUEUE_IMPLEMENTATION
+
+/**
+ *	Sorted array, O(size) enqueue and O(1) dequeue.
+ */
+
+class SortedArrayQueue {
+public:
+	SortedArrayQueue(int param_capacity, int param_max_value);
+	~SortedArrayQueue();
+
+	int size() { return used; }
+
+	void enqueue(int param_index, int param_value);
+	bool dequeue(int *param_index_out, int *param_value_out);
+
+protected:
+	void grow();
+
+	int capacity;
+	int used;
+
+	int *index_queue;
+	int *value_queue;
+};
+
+/**
+ *	Binary minheap, O(log size) enqueue and dequeue.
+ */
+
+class MinHeapQueue {
+public:
+	MinHeapQueue(int param_capacity, int param_max_value);
+	~MinHeapQueue();
+
+	int size() { return used; }
+
+	void enqueue(int param_index, int param_value);
+	bool dequeue(int *param_index_out, int *param_value_out);
+
+	void minheapify(int param_index);
+
+protected:
+	void grow();
+
+	int capacity;
+	int used;
+
+	int *index_queue;
+	int *value_queue;
+};
+
+/**
+ *	Monotone bucket queue, O(1) enqueue and amortized O(1) dequeue
+ *	as long as the dequeued keys never decrease.
+ *	Keys must lie in [0, max_value] and indices in [0, capacity).
+ *	An index is queued at most once, enqueueing an index which is
+ *	already queued moves it to the new key (decrease-key).
+ */
+
+class BucketQueue {
+public:
+	BucketQueue(int param_capacity, int param_max_value);
+	~BucketQueue();
+
+	int size() { return used; }
+
+	void enqueue(int param_index, int param_value);
+	bool dequeue(int *param_index_out, int *param_value_out);
+
+protected:
+	int capacity;
+	int max_value;
+	int used;
+	int min_bucket; //No non-empty bucket below this key
+
+	int *bucket_head; //First index in each bucket, -1 if empty
+	int *bucket_of; //Key of each queued index, -1 if not queued
+	int *next;
+	int *prev;
+};
+
+#if defined(BUCKET_QUEUE_IMPLEMENTATION)
+typedef BucketQueue MinPriorityQueue;
+#elif defined(MINHEAP_QUEUE_IMPLEMENTATION)
+typedef MinHeapQueue MinPriorityQueue;
+#else
+typedef SortedArrayQueue MinPriorityQueue;
+#endif
+
+#endif
@@ -1,365 +1,1710 @@
-
-/**
- *	Water Retention on Magic Squares Solver
- *
- *	Author: Johan Öfverstedt
- *	Modified: July 2012
- *	Version 0.12a
- *
- *	ms_matrix.cpp
- *	Magic Square Matrix Implementation with Water Retention
- *	Algorithm to calculate the Water Retention value and delta
- *
- *	Project website:
- *	sourceforge.net/projects/wrmssolver
- *
- *	Based on thesis:
- *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
- *
- */
- 
-#include <stdlib.h>
-#include <math.h>
-#include <iostream>
-#include "ms_matrix.h"
-
-#define MAX(x, y) (x) >= (y) ? (x) : (y)
-#define MIN(x, y) (x) <= (y) ? (x) : (y)
-
-using namespace std;
-
-MSMatrix::MSMatrix(unsigned int param_n, bool param_associative, bool param_semi_magic) {
-
-	n = param_n;
-	nn = n * n;
-
-	magic_const = n * (nn + 1) / 2;
-
-	mat = new int[nn];
-	row_sum = new int[n];
-	col_sum = new int[n];
-
-	associative = param_associative;
-	if(associative)
-		associative_const = nn + 1;
-	
-	semi_magic = param_semi_magic;
-
-	randomRestart();
-
-	//Setup water retention
-
-	q = new MinPriorityQueue(nn);
-
-	w = new int[nn];
-	w_saved = new int[nn];
-
-}
-
-MSMatrix::~MSMatrix() {
-	
-	if(mat)
-		delete[] mat;
-	
-	if(row_sum)
-		delete[] row_sum;
-
-	if(col_sum)
-		delete[] col_sum;
-
-	delete[] w;
-	delete[] w_saved;
-	delete q;
-
-}
-
-void MSMatrix::randomRestart() {
-
-	int inc = 1;
-	for(int i = 0; i < nn; ++i) {
-		mat[i] = inc++;
-	}
-
-	for(int i = 0; i < nn - 1; ++i) {
-		int ri = i + rand() % (n * n - i);
-
-		int tmp = mat[i];
-		mat[i] = mat[ri];
-		mat[ri] = tmp;
-	}
-
-	violation();
-
-}
-
-void MSMatrix::doSwap(int param_index1, int param_index2) {
-
-	int tmp = mat[param_index1];
-	mat[param_index1] = mat[param_index2];
-	mat[param_index2] = tmp;
-
-	//violation();
-
-}
-
-int MSMatrix::violation() {
-
-	int s = 0;
-
-	//Reset violation value
-
-	cur_violation = 0;
-
-	//Row constraints
-
-	for(int i = 0; i < n; ++i) {
-		s = 0;
-		for(int j = 0; j < n; ++j) {
-			s += mat[i * n + j];
-		}
-		row_sum[i] = s;
-		cur_violation += abs(row_sum[i] - magic_const);
-	}
-
-	//Col constraints
-
-	for(int i = 0; i < n; ++i) {
-		s = 0;
-		for(int j = 0; j < n; ++j) {
-			s += mat[j * n + i];
-		}
-		col_sum[i] = s;
-		cur_violation += abs(col_sum[i] - magic_const);
-	}
-
-	//Diag constraints
-
-	if(!semi_magic) {
-
-		right_diag_sum = 0;
-		left_diag_sum = 0;
-
-		for(int i = 0; i < n; ++i) {
-			right_diag_sum += mat[i * n + i];
-			left_diag_sum += mat[(n - i - 1) * n + i];
-		}
-
-		cur_violation += abs(right_diag_sum - magic_const);
-		cur_violation += abs(left_diag_sum - magic_const);
-	
-	}
-
-	if(associative) {
-	
-		int nnhalf = nn / 2;
-		
-		for(int i = 0; i < nnhalf; ++i) {
-			cur_violation += abs(mat[i] + mat[(nn-i-1)] - associative_const);
-		}
-		
-	}
-	
-	return cur_violation;
-
-}
-
-int MSMatrix::swapDelta(int param_index1, int param_index2) {
-
-	int i1 = param_index1 / n;
-	int j1 = param_index1 % n;
-	int i2 = param_index2 / n;
-	int j2 = param_index2 % n;
-
-	int delta = 0;
-
-	//Row constraints
-
-	if(i1 != i2) { //Different rows
-		delta += abs(row_sum[i1] - mat[param_index1] + mat[param_index2] - magic_const) - abs(row_sum[i1] - magic_const);
-		delta += abs(row_sum[i2] - mat[param_index2] + mat[param_index1] - magic_const) - abs(row_sum[i2] - magic_const);
-	}
-
-	if(j1 != j2) { //Different columns
-		delta += abs(col_sum[j1] - mat[param_index1] + mat[param_index2] - magic_const) - abs(col_sum[j1] - magic_const);
-		delta += abs(col_sum[j2] - mat[param_index2] + mat[param_index1] - magic_const) - abs(col_sum[j2] - magic_const);
-	}
-
-	if(!semi_magic) {
-	
-		if(i1 == j1 && i2 != j2) { //First in right column but second is not
-			delta += abs(right_diag_sum - mat[param_index1] + mat[param_index2] - magic_const) - abs(right_diag_sum - magic_const);
-		}
-		if(i1 != j1 && i2 == j2) { //First in right column but second is not
-			delta += abs(right_diag_sum - mat[param_index2] + mat[param_index1] - magic_const) - abs(right_diag_sum - magic_const);
-		}
-
-		if(i1 == (n - j1 - 1) && i2 != (n - j2 - 1)) { //First in right column but second is not
-			delta += abs(left_diag_sum - mat[param_index1] + mat[param_index2] - magic_const) - abs(left_diag_sum - magic_const);
-		}
-		if(i1 != (n - j1 - 1) && i2 == (n - j2 - 1)) { //First in right column but second is not
-			delta += abs(left_diag_sum - mat[param_index2] + mat[param_index1] - magic_const) - abs(left_diag_sum - magic_const);
-		}
-	
-	}
-
-	if(associative) {
-		
-		if(param_index1 != (nn - param_index2 - 1)) { //Elements not associative-pair
-			delta += abs((mat[param_index2] + mat[nn - param_index1 - 1] - associative_const)) - abs((mat[param_index1] + mat[nn - param_index1 - 1] - associative_const));
-			delta += abs((mat[param_index1] + mat[nn - param_index2 - 1] - associative_const)) - abs((mat[param_index2] + mat[nn - param_index2 - 1] - associative_const));
-		}
-		
-	}
-	
-	return delta;
-
-}
-
-void MSMatrix::consolePrint() {
-
-	for(int i = 0; i < n; ++i) {
-		for(int j = 0; j < n; ++j) {
-			cout << mat[i * n + j] << "\t";
-		}
-		cout << endl;
-	}
-
-}
-
-int MSMatrix::retention() {
-
-	//Init corners:
-	w[0] = mat[0];
-	w[n - 1] = mat[n - 1];
-	w[nn - n] = mat[nn - n];
-	w[nn - 1] = mat[nn - 1];
-
-	//Init edges:
-	for(int i = 1; i < n - 1; ++i) {
-		w[i] = mat[i];
-		w[nn - i - 1] = mat[nn - i - 1];
-		w[i * n] = mat[i * n];
-		w[n - 1 + i * n] = mat[n - 1 + i * n];
-
-		q->enqueue(i, w[i]);
-		q->enqueue(nn - i - 1, w[nn - i - 1]);
-		q->enqueue(i * n, w[i * n]);
-		q->enqueue(n - 1 + i * n, w[n - 1 + i * n]);
-	}
-	
-	//Init middle:
-	for(int i = 1; i < n - 1; ++i) {
-		for(int j = 1; j < n - 1; ++j) {
-			w[i * n + j] = nn;
-		}
-	}
-
-	while(q->size() > 0) {
-
-		int ind = 0;
-		int val = 0;
-
-		q->dequeue(&ind, &val);
-
-		//int indmod = ind % n;
-		//int inddiv = ind / n;
-		//if(indmod > 1)
-			drain(ind - 1, val);
-		//if(indmod < n - 1)
-			drain(ind + 1, val);
-		//if(inddiv > 0)
-			drain(ind - n, val);
-		//if(inddiv < n - 1)
-			drain(ind + n, val);
-
-	}
-
-	last_retention = 0;
-
-	for(int i = 0; i < nn; ++i)
-		last_retention += w[i] - mat[i];
-
-	return last_retention;
-
-}
-
-int MSMatrix::swapRetentionDelta(int param_index1, int param_index2) {
-
-	if(w[param_index1] > mat[param_index1] && w[param_index2] > mat[param_index2]) {
-		if(w[param_index2] > mat[param_index1] && w[param_index1] > mat[param_index2]) {
-			return 0;
-		}
-	}
-
-	int max_w1 = 0;
-	if(param_index1 - 1 >= 0)
-		max_w1 = MAX(max_w1, w[param_index1 - 1]);
-	if(param_index1 + 1 < nn)
-		max_w1 = MAX(max_w1, w[param_index1 + 1]);
-	if(param_index1 - n >= 0)
-		max_w1 = MAX(max_w1, w[param_index1 - n]);
-	if(param_index1 + n < nn)
-		max_w1 = MAX(max_w1, w[param_index1 + n]);
-
-	int max_w2 = 0;
-	if(param_index2 - 1 >= 0)
-		max_w2 = MAX(max_w2, w[param_index2 - 1]);
-	if(param_index2 + 1 < nn)
-		max_w2 = MAX(max_w2, w[param_index2 + 1]);
-	if(param_index2 - n >= 0)
-		max_w2 = MAX(max_w2, w[param_index2 - n]);
-	if(param_index2 + n < nn)
-		max_w2 = MAX(max_w2, w[param_index2 + n]);
-
-	if(w[param_index1] == mat[param_index1] && w[param_index2] == mat[param_index2]) {
-		
-		if(mat[param_index2] > max_w1 && mat[param_index1] > max_w2)
-			return 0;
-
-	}
-
-	int pre = last_retention;
-	int delta = 0;
-
-	doSwap(param_index1, param_index2);
-
-	retention();
-
-	delta = last_retention - pre;
-
-	doSwap(param_index1, param_index2);
-
-	loadWaterLevels();
-
-	last_retention = pre;
-
-	return delta;
-
-}
-
-void MSMatrix::saveWaterLevels() {
-
-	for(int i = 0; i < nn; ++i)
-		w_saved[i] = w[i];
-
-}
-
-void MSMatrix::loadWaterLevels() {
-
-	for(int i = 0; i < nn; ++i)
-		w[i] = w_saved[i];
-
-}
-
-void MSMatrix::drain(int param_index, int param_value) {
-
-	if(param_index < 0 || param_index >= nn)
-		return;
-
-	int tmp = MAX(mat[param_index], param_value);
-	if(tmp < w[param_index]) {
-		w[param_index] = tmp;
-		q->enqueue(param_index, tmp);
-	}
-
-}
\ No newline at end of file
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	ms_matrix.cpp
+ *	Magic Square Matrix Implementation with Water Retention
+ *	Algorithm to calculate the Water Retention value and delta
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+ 
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <iostream>
+#include "ms_matrix.h"
+
+#define MAX(x, y) (x) >= (y) ? (x) : (y)
+#define MIN(x, y) (x) <= (y) ? (x) : (y)
+
+using namespace std;
+
+/**
+ *	Places an array of param_count elements at the next cache line
+ *	boundary after param_offset. Returns NULL when only measuring.
+ */
+
+template<class T>
+static T *carveArray(char *param_base, size_t *param_offset, int param_count) {
+
+	size_t offset = ((*param_offset) + 63) & ~((size_t)63);
+	(*param_offset) = offset + param_count * sizeof(T);
+
+	if(!param_base)
+		return 0;
+
+	return (T*)(param_base + offset);
+
+}
+
+template<int N, int Mode>
+MSMatrix<N, Mode>::MSMatrix(unsigned int param_n, bool param_associative, bool param_semi_magic) {
+
+	//Only sets the dimension and mode of the runtime specialization
+	this->setDimensions(param_n, param_associative, param_semi_magic);
+
+	magic_const = n * (nn + 1) / 2;
+
+	//Allocate every array in one block, measure it first
+
+	storage = 0;
+	storage_size = layoutStorage(0);
+
+	storage = new char[storage_size + 63];
+	layoutStorage((char*)(((size_t)storage + 63) & ~((size_t)63)));
+
+	//The padding ring around the matrix is dry land at level 0, so
+	//the flood never has to check bounds and border cells drain to it
+
+	for(int i = 0; i < pnn; ++i) {
+		mat[i] = 0;
+		w[i] = 0;
+	}
+
+	for(int i = 0; i < nn; ++i) {
+		cell_row[i] = i / n;
+		cell_col[i] = i % n;
+		cell_pad[i] = (i / n + 1) * stride + (i % n) + 1;
+	}
+
+	if(associative)
+		associative_const = nn + 1;
+
+	merge_tree_valid = false;
+
+	randomRestart();
+
+	//Setup water retention
+
+	q = new MinPriorityQueue(pnn, nn);
+
+	journal_size = 0;
+	journal_stamp = 0;
+	water_delta = 0;
+	move_swaps = 0;
+	move_merge_tree_valid = false;
+
+	region_stamp = 0;
+
+	for(int i = 0; i < pnn; ++i) {
+		journal_mark[i] = 0;
+		region_mark[i] = 0;
+	}
+
+	cycle_stamp = 0;
+
+	for(int i = 0; i < 2 * n + 2; ++i)
+		line_mark[i] = 0;
+	for(int i = 0; i < nn; ++i)
+		cycle_mark[i] = 0;
+
+}
+
+template<int N, int Mode>
+MSMatrix<N, Mode>::MSMatrix(const MSMatrix &param_other) : MSDimensions<N, Mode>(param_other) {
+
+	magic_const = param_other.magic_const;
+	associative_const = param_other.associative_const;
+
+	storage = 0;
+	storage_size = layoutStorage(0);
+
+	storage = new char[storage_size + 63];
+	layoutStorage((char*)(((size_t)storage + 63) & ~((size_t)63)));
+
+	copyState(param_other);
+
+	q = new MinPriorityQueue(pnn, nn);
+
+}
+
+template<int N, int Mode>
+MSMatrix<N, Mode>::~MSMatrix() {
+
+	if(storage)
+		delete[] storage;
+
+	delete q;
+
+}
+
+template<int N, int Mode>
+size_t MSMatrix<N, Mode>::layoutStorage(char *param_base) {
+
+	size_t offset = 0;
+
+	//Hot arrays first
+
+	mat = carveArray<cell_t>(param_base, &offset, pnn);
+	w = carveArray<cell_t>(param_base, &offset, pnn);
+	row_sum = carveArray<int>(param_base, &offset, n);
+	col_sum = carveArray<int>(param_base, &offset, n);
+	cell_pad = carveArray<int>(param_base, &offset, nn);
+	cell_row = carveArray<short>(param_base, &offset, nn);
+	cell_col = carveArray<short>(param_base, &offset, nn);
+
+	journal_index = carveArray<int>(param_base, &offset, pnn);
+	journal_level = carveArray<cell_t>(param_base, &offset, pnn);
+	journal_mark = carveArray<int>(param_base, &offset, pnn);
+	region = carveArray<int>(param_base, &offset, pnn);
+	region_mark = carveArray<int>(param_base, &offset, pnn);
+	move_log = carveArray<int>(param_base, &offset, 2 * nn);
+	line_excess = carveArray<int>(param_base, &offset, 2 * n + 2);
+	line_change = carveArray<int>(param_base, &offset, 2 * n + 2);
+	line_mark = carveArray<int>(param_base, &offset, 2 * n + 2);
+	cycle_lines = carveArray<int>(param_base, &offset, 2 * n + 2);
+	cycle_mark = carveArray<int>(param_base, &offset, nn);
+	cycle_value = carveArray<int>(param_base, &offset, nn);
+
+	value_count = carveArray<int>(param_base, &offset, nn + 2);
+	cell_order = carveArray<int>(param_base, &offset, nn);
+	uf_parent = carveArray<int>(param_base, &offset, pnn);
+	uf_size = carveArray<int>(param_base, &offset, pnn);
+	uf_drained = carveArray<bool>(param_base, &offset, pnn);
+	member_first = carveArray<int>(param_base, &offset, pnn);
+	member_last = carveArray<int>(param_base, &offset, pnn);
+	member_next = carveArray<int>(param_base, &offset, pnn);
+	basin = carveArray<int>(param_base, &offset, pnn);
+	basin_spill = carveArray<int>(param_base, &offset, pnn);
+	basin_spill_cell = carveArray<int>(param_base, &offset, pnn);
+	basin_size = carveArray<int>(param_base, &offset, pnn);
+	spill_count = carveArray<int>(param_base, &offset, pnn);
+	basin_retention = carveArray<int>(param_base, &offset, pnn);
+	level_count_below = carveArray<int>(param_base, &offset, nn + 2);
+	level_sum_below = carveArray<int>(param_base, &offset, nn + 2);
+
+	return offset;
+
+}
+
+/**
+ *	Copies the matrix, the sums, the water levels and the merge tree
+ *	of a matrix with the same dimension and mode, so a worker thread
+ *	can evaluate swaps on its own copy.
+ */
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::copyState(const MSMatrix &param_other) {
+
+	//mat is the first array of the block
+	memcpy(mat, param_other.mat, storage_size);
+
+	cur_violation = param_other.cur_violation;
+	right_diag_sum = param_other.right_diag_sum;
+	left_diag_sum = param_other.left_diag_sum;
+	last_retention = param_other.last_retention;
+	merge_tree_valid = param_other.merge_tree_valid;
+
+	journal_size = param_other.journal_size;
+	journal_stamp = param_other.journal_stamp;
+	water_delta = param_other.water_delta;
+	move_swaps = param_other.move_swaps;
+	move_merge_tree_valid = param_other.move_merge_tree_valid;
+	region_stamp = param_other.region_stamp;
+	cycle_stamp = param_other.cycle_stamp;
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::randomRestart() {
+
+	int inc = 1;
+	for(int i = 0; i < nn; ++i) {
+		mat[cell_pad[i]] = inc++;
+	}
+
+	for(int i = 0; i < nn - 1; ++i) {
+		int ri = i + random.nextInt(nn - i);
+
+		cell_t tmp = mat[cell_pad[i]];
+		mat[cell_pad[i]] = mat[cell_pad[ri]];
+		mat[cell_pad[ri]] = tmp;
+	}
+
+	merge_tree_valid = false;
+
+	violation();
+
+}
+
+template<int N, int Mode>
+int MSMatrix<N, Mode>::getLineMoveCount() {
+
+	if(semi_magic && !associative)
+		return n * (n - 1);
+
+	//For every l1 < n / 2 the lines l2 in (l1, n - 1 - l1] but the
+	//center
+	int count = 0;
+	for(int l1 = 0; l1 < n / 2; ++l1)
+		count += n - 1 - 2 * l1 - (n % 2);
+
+	return count;
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::decodeLineMove(int param_move, int *param_line1_out, int *param_line2_out, bool *param_columns_out) {
+
+	int m = param_move;
+
+	if(semi_magic && !associative) {
+		int pairs = n * (n - 1) / 2;
+		*param_columns_out = m >= pairs;
+		if(m >= pairs)
+			m -= pairs;
+		int l1 = 0;
+		while(m >= n - 1 - l1) {
+			m -= n - 1 - l1;
+			++l1;
+		}
+		*param_line1_out = l1;
+		*param_line2_out = l1 + 1 + m;
+		return;
+	}
+
+	*param_columns_out = false;
+	int l1 = 0;
+	while(m >= n - 1 - 2 * l1 - (n % 2)) {
+		m -= n - 1 - 2 * l1 - (n % 2);
+		++l1;
+	}
+	int l2 = l1 + 1 + m;
+	if(n % 2 == 1 && l2 >= n / 2)
+		++l2;
+	*param_line1_out = l1;
+	*param_line2_out = l2;
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::getLineMoveLines(int param_move, int *param_lines_out) {
+
+	int l1, l2;
+	bool columns;
+	decodeLineMove(param_move, &l1, &l2, &columns);
+
+	param_lines_out[0] = columns ? n + l1 : l1;
+	param_lines_out[1] = columns ? n + l2 : l2;
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::doLineMove(int param_move) {
+
+	int l1, l2;
+	bool columns;
+	decodeLineMove(param_move, &l1, &l2, &columns);
+
+	if(semi_magic && !associative) {
+		if(columns)
+			exchangeColumns(l1, l2);
+		else
+			exchangeRows(l1, l2);
+	} else {
+		exchangeRows(l1, l2);
+		exchangeColumns(l1, l2);
+		if(l2 != n - 1 - l1) {
+			exchangeRows(n - 1 - l1, n - 1 - l2);
+			exchangeColumns(n - 1 - l1, n - 1 - l2);
+		}
+	}
+
+	merge_tree_valid = false;
+
+	violation();
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::exchangeRows(int param_row1, int param_row2) {
+
+	int p1 = (param_row1 + 1) * stride + 1;
+	int p2 = (param_row2 + 1) * stride + 1;
+
+	for(int c = 0; c < n; ++c) {
+		cell_t tmp = mat[p1 + c];
+		mat[p1 + c] = mat[p2 + c];
+		mat[p2 + c] = tmp;
+	}
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::exchangeColumns(int param_col1, int param_col2) {
+
+	int p1 = stride + param_col1 + 1;
+	int p2 = stride + param_col2 + 1;
+
+	for(int r = 0; r < n; ++r) {
+		cell_t tmp = mat[p1 + r * stride];
+		mat[p1 + r * stride] = mat[p2 + r * stride];
+		mat[p2 + r * stride] = tmp;
+	}
+
+}
+
+template<int N, int Mode>
+bool MSMatrix<N, Mode>::constructiveRestart() {
+
+	int *square = new int[nn];
+
+	if(n % 2 == 1)
+		siameseSquare(n, square);
+	else if(n % 4 == 0)
+		complementSquare(n, square);
+	else if(n > 2 && !associative)
+		luxSquare(n, square);
+	else {
+		delete[] square;
+		return false;
+	}
+
+	int *row_perm = new int[n];
+	int *col_perm = new int[n];
+
+	if(semi_magic && !associative) {
+		//Without the diagonals any permutation of the rows and of the
+		//columns keeps the sums
+		for(int i = 0; i < n; ++i) {
+			row_perm[i] = i;
+			col_perm[i] = i;
+		}
+		for(int i = 0; i < n - 1; ++i) {
+			int ri = i + random.nextInt(n - i);
+			int tmp = row_perm[i];
+			row_perm[i] = row_perm[ri];
+			row_perm[ri] = tmp;
+			ri = i + random.nextInt(n - i);
+			tmp = col_perm[i];
+			col_perm[i] = col_perm[ri];
+			col_perm[ri] = tmp;
+		}
+	} else {
+		//The pairs of rows { i, n - 1 - i } are permuted and each pair
+		//is flipped or not, the same permutation of the columns keeps
+		//the cells of the diagonals and the associative pairs together
+		int half = n / 2;
+		for(int i = 0; i < half; ++i)
+			row_perm[i] = i;
+		for(int i = 0; i < half - 1; ++i) {
+			int ri = i + random.nextInt(half - i);
+			int tmp = row_perm[i];
+			row_perm[i] = row_perm[ri];
+			row_perm[ri] = tmp;
+		}
+		for(int i = 0; i < half; ++i) {
+			if(random.nextInt(2))
+				row_perm[i] = n - 1 - row_perm[i];
+			row_perm[n - 1 - i] = n - 1 - row_perm[i];
+		}
+		if(n % 2 == 1)
+			row_perm[half] = half;
+		for(int i = 0; i < n; ++i)
+			col_perm[i] = row_perm[i];
+	}
+
+	//A reflection, a transposition and the complement, with the
+	//reflections of the permutations they give all 8 symmetries
+	bool reflect = random.nextInt(2) != 0;
+	bool transpose = random.nextInt(2) != 0;
+	bool complement = random.nextInt(2) != 0;
+
+	for(int i = 0; i < nn; ++i) {
+		int r = reflect ? n - 1 - cell_row[i] : cell_row[i];
+		int c = cell_col[i];
+		int value = transpose ? square[row_perm[c] * n + col_perm[r]] : square[row_perm[r] * n + col_perm[c]];
+		mat[cell_pad[i]] = complement ? nn + 1 - value : value;
+	}
+
+	delete[] square;
+	delete[] row_perm;
+	delete[] col_perm;
+
+	merge_tree_valid = false;
+
+	violation();
+
+	return true;
+
+}
+
+//The Siamese method: 1 in the middle of the top row, then up and to
+//the right wrapping around, or down when that cell is taken. The
+//square is associative.
+template<int N, int Mode>
+void MSMatrix<N, Mode>::siameseSquare(int param_n, int *param_square_out) {
+
+	int n = param_n;
+
+	for(int i = 0; i < n * n; ++i)
+		param_square_out[i] = 0;
+
+	int r = 0;
+	int c = n / 2;
+	for(int value = 1; value <= n * n; ++value) {
+		param_square_out[r * n + c] = value;
+		int next_r = (r + n - 1) % n;
+		int next_c = (c + 1) % n;
+		if(param_square_out[next_r * n + next_c] != 0) {
+			next_r = (r + 1) % n;
+			next_c = c;
+		}
+		r = next_r;
+		c = next_c;
+	}
+
+}
+
+//Doubly even n: 1 to n * n in row major order, complemented on the
+//diagonals of every 4 x 4 block. The square is associative.
+template<int N, int Mode>
+void MSMatrix<N, Mode>::complementSquare(int param_n, int *param_square_out) {
+
+	int n = param_n;
+
+	for(int r = 0; r < n; ++r) {
+		for(int c = 0; c < n; ++c) {
+			int value = r * n + c + 1;
+			if(r % 4 == c % 4 || r % 4 + c % 4 == 3)
+				value = n * n + 1 - value;
+			param_square_out[r * n + c] = value;
+		}
+	}
+
+}
+
+//Conway's LUX method for n = 4m + 2: a Siamese square of order
+//2m + 1 where every cell becomes a 2 x 2 block, filled in the order of
+//an L in the top m + 1 rows, a U in the next and an X in the rest,
+//with the middle U exchanged for the L above it.
+template<int N, int Mode>
+void MSMatrix<N, Mode>::luxSquare(int param_n, int *param_square_out) {
+
+	int n = param_n;
+	int m = (n - 2) / 4;
+	int k = 2 * m + 1;
+
+	//Order of the cells top left, top right, bottom left, bottom right
+	static const int lux[3][4] = { { 4, 1, 2, 3 }, { 1, 4, 2, 3 }, { 1, 4, 3, 2 } };
+
+	int *base = new int[k * k];
+	siameseSquare(k, base);
+
+	for(int br = 0; br < k; ++br) {
+		for(int bc = 0; bc < k; ++bc) {
+			int pattern = br <= m ? 0 : (br == m + 1 ? 1 : 2);
+			if(bc == m && br == m)
+				pattern = 1;
+			else if(bc == m && br == m + 1)
+				pattern = 0;
+
+			int offset = 4 * (base[br * k + bc] - 1);
+			int r = 2 * br;
+			int c = 2 * bc;
+			param_square_out[r * n + c] = offset + lux[pattern][0];
+			param_square_out[r * n + c + 1] = offset + lux[pattern][1];
+			param_square_out[(r + 1) * n + c] = offset + lux[pattern][2];
+			param_square_out[(r + 1) * n + c + 1] = offset + lux[pattern][3];
+		}
+	}
+
+	delete[] base;
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::updateSums(int param_index1, int param_index2) {
+
+	cur_violation += swapDelta(param_index1, param_index2);
+
+	int i1 = cell_row[param_index1];
+	int j1 = cell_col[param_index1];
+	int i2 = cell_row[param_index2];
+	int j2 = cell_col[param_index2];
+
+	int p1 = cell_pad[param_index1];
+	int p2 = cell_pad[param_index2];
+
+	int d = mat[p2] - mat[p1];
+
+	row_sum[i1] += d;
+	row_sum[i2] -= d;
+	col_sum[j1] += d;
+	col_sum[j2] -= d;
+
+	if(!semi_magic) {
+		if(i1 == j1)
+			right_diag_sum += d;
+		if(i2 == j2)
+			right_diag_sum -= d;
+		if(i1 == n - j1 - 1)
+			left_diag_sum += d;
+		if(i2 == n - j2 - 1)
+			left_diag_sum -= d;
+	}
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::doSwap(int param_index1, int param_index2) {
+
+	//Update the violation and the sums incrementally
+
+	updateSums(param_index1, param_index2);
+
+	int p1 = cell_pad[param_index1];
+	int p2 = cell_pad[param_index2];
+
+	cell_t tmp = mat[p1];
+	mat[p1] = mat[p2];
+	mat[p2] = tmp;
+
+	merge_tree_valid = false;
+
+#ifdef CHECK_INCREMENTAL_VIOLATION
+	checkViolation();
+#endif
+
+}
+
+/**
+ *	Tentative moves keep the water journal open from beginMove() to
+ *	the commit or the rollback, every water level is journaled once
+ *	with its level before the move. The swaps are logged in order in
+ *	move_log, rollbackMove() undoes them in reverse, which restores the
+ *	cells and the sums, and then restores the levels from the journal.
+ */
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::beginMove() {
+
+	move_swaps = 0;
+	move_merge_tree_valid = merge_tree_valid;
+
+	beginWaterJournal();
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::applySwap(int param_index1, int param_index2) {
+
+	move_log[2 * move_swaps] = param_index1;
+	move_log[2 * move_swaps + 1] = param_index2;
+	++move_swaps;
+
+	updateSums(param_index1, param_index2);
+
+	int p1 = cell_pad[param_index1];
+	int p2 = cell_pad[param_index2];
+
+	int value1 = mat[p1];
+	int value2 = mat[p2];
+
+	//The higher value is moved first, as in swapRetentionDelta()
+
+	if(value1 < value2) {
+		raiseCell(p1, value2);
+		lowerCell(p2, value1);
+	} else {
+		raiseCell(p2, value1);
+		lowerCell(p1, value2);
+	}
+
+	merge_tree_valid = false;
+
+#ifdef CHECK_INCREMENTAL_VIOLATION
+	checkViolation();
+#endif
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::commitMove() {
+
+	last_retention += water_delta;
+
+	journal_size = 0;
+	water_delta = 0;
+	move_swaps = 0;
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::rollbackMove() {
+
+	for(int k = move_swaps - 1; k >= 0; --k) {
+		int p1 = cell_pad[move_log[2 * k]];
+		int p2 = cell_pad[move_log[2 * k + 1]];
+
+		updateSums(move_log[2 * k], move_log[2 * k + 1]);
+
+		cell_t tmp = mat[p1];
+		mat[p1] = mat[p2];
+		mat[p2] = tmp;
+	}
+
+	move_swaps = 0;
+
+	rollbackWaterJournal();
+
+	merge_tree_valid = move_merge_tree_valid;
+
+#ifdef CHECK_INCREMENTAL_VIOLATION
+	checkViolation();
+#endif
+
+}
+
+#ifdef CHECK_INCREMENTAL_VIOLATION
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::checkViolation() {
+
+	int stored_violation = cur_violation;
+	int stored_right_diag_sum = right_diag_sum;
+	int stored_left_diag_sum = left_diag_sum;
+
+	bool sums_ok = true;
+	for(int i = 0; i < n; ++i) {
+		int row = 0;
+		int col = 0;
+		for(int j = 0; j < n; ++j) {
+			row += mat[(i + 1) * stride + j + 1];
+			col += mat[(j + 1) * stride + i + 1];
+		}
+		sums_ok = sums_ok && row == row_sum[i] && col == col_sum[i];
+	}
+
+	violation();
+
+	if(!semi_magic)
+		sums_ok = sums_ok && stored_right_diag_sum == right_diag_sum && stored_left_diag_sum == left_diag_sum;
+
+	if(!sums_ok || stored_violation != cur_violation) {
+		cerr << "Incremental violation mismatch: " << stored_violation << " (recomputed: " << cur_violation << ")" << endl;
+	}
+
+}
+
+#endif
+
+template<int N, int Mode>
+int MSMatrix<N, Mode>::violation() {
+
+	int s = 0;
+
+	//Reset violation value
+
+	cur_violation = 0;
+
+	//Row constraints
+
+	for(int i = 0; i < n; ++i) {
+		const cell_t *row = mat + (i + 1) * stride + 1;
+		s = 0;
+		for(int j = 0; j < n; ++j) {
+			s += row[j];
+		}
+		row_sum[i] = s;
+		cur_violation += abs(row_sum[i] - magic_const);
+	}
+
+	//Col constraints
+
+	for(int i = 0; i < n; ++i)
+		col_sum[i] = 0;
+
+	for(int j = 0; j < n; ++j) {
+		const cell_t *row = mat + (j + 1) * stride + 1;
+		for(int i = 0; i < n; ++i) {
+			col_sum[i] += row[i];
+		}
+	}
+
+	for(int i = 0; i < n; ++i)
+		cur_violation += abs(col_sum[i] - magic_const);
+
+	//Diag constraints
+
+	if(!semi_magic) {
+
+		right_diag_sum = 0;
+		left_diag_sum = 0;
+
+		for(int i = 0; i < n; ++i) {
+			right_diag_sum += mat[(i + 1) * stride + i + 1];
+			left_diag_sum += mat[(n - i) * stride + i + 1];
+		}
+
+		cur_violation += abs(right_diag_sum - magic_const);
+		cur_violation += abs(left_diag_sum - magic_const);
+
+	}
+
+	if(associative) {
+
+		int nnhalf = nn / 2;
+
+		for(int i = 0; i < nnhalf; ++i) {
+			cur_violation += abs(mat[cell_pad[i]] + mat[cell_pad[nn - i - 1]] - associative_const);
+		}
+
+	}
+
+	return cur_violation;
+
+}
+
+template<int N, int Mode>
+int MSMatrix<N, Mode>::swapDelta(int param_index1, int param_index2) {
+
+	int i1 = cell_row[param_index1];
+	int j1 = cell_col[param_index1];
+	int i2 = cell_row[param_index2];
+	int j2 = cell_col[param_index2];
+
+	int v1 = mat[cell_pad[param_index1]];
+	int v2 = mat[cell_pad[param_index2]];
+
+	int delta = 0;
+
+	//Row constraints
+
+	if(i1 != i2) { //Different rows
+		delta += abs(row_sum[i1] - v1 + v2 - magic_const) - abs(row_sum[i1] - magic_const);
+		delta += abs(row_sum[i2] - v2 + v1 - magic_const) - abs(row_sum[i2] - magic_const);
+	}
+
+	if(j1 != j2) { //Different columns
+		delta += abs(col_sum[j1] - v1 + v2 - magic_const) - abs(col_sum[j1] - magic_const);
+		delta += abs(col_sum[j2] - v2 + v1 - magic_const) - abs(col_sum[j2] - magic_const);
+	}
+
+	if(!semi_magic) {
+
+		if(i1 == j1 && i2 != j2) { //First in right column but second is not
+			delta += abs(right_diag_sum - v1 + v2 - magic_const) - abs(right_diag_sum - magic_const);
+		}
+		if(i1 != j1 && i2 == j2) { //First in right column but second is not
+			delta += abs(right_diag_sum - v2 + v1 - magic_const) - abs(right_diag_sum - magic_const);
+		}
+
+		if(i1 == (n - j1 - 1) && i2 != (n - j2 - 1)) { //First in right column but second is not
+			delta += abs(left_diag_sum - v1 + v2 - magic_const) - abs(left_diag_sum - magic_const);
+		}
+		if(i1 != (n - j1 - 1) && i2 == (n - j2 - 1)) { //First in right column but second is not
+			delta += abs(left_diag_sum - v2 + v1 - magic_const) - abs(left_diag_sum - magic_const);
+		}
+
+	}
+
+	if(associative) {
+
+		int pair1 = nn - param_index1 - 1;
+		int pair2 = nn - param_index2 - 1;
+
+		//The center of an odd square is its own pair and not constrained
+		if(param_index1 != pair2) { //Elements not associative-pair
+			if(param_index1 != pair1) {
+				int pv1 = mat[cell_pad[pair1]];
+				delta += abs((v2 + pv1 - associative_const)) - abs((v1 + pv1 - associative_const));
+			}
+			if(param_index2 != pair2) {
+				int pv2 = mat[cell_pad[pair2]];
+				delta += abs((v1 + pv2 - associative_const)) - abs((v2 + pv2 - associative_const));
+			}
+		}
+
+	}
+
+	return delta;
+
+}
+
+/**
+ *	A cycle changes the sum of a line by the changes of the values of
+ *	its cells in the line, which are gathered first, so a line with
+ *	several cells of the cycle adds its deviation once. An associative
+ *	pair with both cells in the cycle is counted at its lower cell.
+ */
+
+template<int N, int Mode>
+int MSMatrix<N, Mode>::lineSum(int param_line) {
+
+	if(param_line < n)
+		return row_sum[param_line];
+	if(param_line < 2 * n)
+		return col_sum[param_line - n];
+	return param_line == 2 * n ? right_diag_sum : left_diag_sum;
+
+}
+
+template<int N, int Mode>
+int MSMatrix<N, Mode>::cycleViolationDelta(const int *param_cells, int param_count, const int *param_line_excess) {
+
+	++cycle_stamp;
+
+	int touched = 0;
+
+	for(int k = 0; k < param_count; ++k) {
+		int cell = param_cells[k];
+		int next = param_cells[k + 1 < param_count ? k + 1 : 0];
+
+		int value = mat[cell_pad[next]];
+		int d = value - mat[cell_pad[cell]];
+
+		cycle_mark[cell] = cycle_stamp;
+		cycle_value[cell] = value;
+
+		int i = cell_row[cell];
+		int j = cell_col[cell];
+
+		int lines[4];
+		int line_count = 0;
+		lines[line_count++] = i;
+		lines[line_count++] = n + j;
+		if(!semi_magic) {
+			if(i == j)
+				lines[line_count++] = 2 * n;
+			if(i == n - j - 1)
+				lines[line_count++] = 2 * n + 1;
+		}
+
+		for(int l = 0; l < line_count; ++l) {
+			int line = lines[l];
+			if(line_mark[line] != cycle_stamp) {
+				line_mark[line] = cycle_stamp;
+				line_change[line] = 0;
+				cycle_lines[touched++] = line;
+			}
+			line_change[line] += d;
+		}
+	}
+
+	int delta = 0;
+
+	for(int t = 0; t < touched; ++t) {
+		int line = cycle_lines[t];
+		int excess = param_line_excess ? param_line_excess[line] : lineSum(line) - magic_const;
+		delta += abs(excess + line_change[line]) - abs(excess);
+	}
+
+	if(associative) {
+
+		for(int k = 0; k < param_count; ++k) {
+			int cell = param_cells[k];
+			int pair = nn - cell - 1;
+
+			//The center of an odd square is its own pair and not constrained
+			if(pair == cell)
+				continue;
+
+			int pair_value = mat[cell_pad[pair]];
+			int pair_after = pair_value;
+			if(cycle_mark[pair] == cycle_stamp) {
+				if(pair < cell)
+					continue;
+				pair_after = cycle_value[pair];
+			}
+
+			delta += abs(cycle_value[cell] + pair_after - associative_const) - abs(mat[cell_pad[cell]] + pair_value - associative_const);
+		}
+
+	}
+
+	return delta;
+
+}
+
+template<int N, int Mode>
+int MSMatrix<N, Mode>::cycleDelta(const int *param_cells, int param_count) {
+
+	return cycleViolationDelta(param_cells, param_count, (const int*)0);
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::cycleDeltas(const int *param_cells, const int *param_starts, int param_moves, int *param_deltas_out) {
+
+	int lines = semi_magic ? 2 * n : 2 * n + 2;
+	for(int l = 0; l < lines; ++l)
+		line_excess[l] = lineSum(l) - magic_const;
+
+	for(int m = 0; m < param_moves; ++m)
+		param_deltas_out[m] = cycleViolationDelta(param_cells + param_starts[m], param_starts[m + 1] - param_starts[m], line_excess);
+
+}
+
+//The cycle is made by swapping each cell with the next, the value of
+//the first cell moves along to the last
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::doCycle(const int *param_cells, int param_count) {
+
+	for(int k = 0; k + 1 < param_count; ++k)
+		doSwap(param_cells[k], param_cells[k + 1]);
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::applyCycle(const int *param_cells, int param_count) {
+
+	for(int k = 0; k + 1 < param_count; ++k)
+		applySwap(param_cells[k], param_cells[k + 1]);
+
+}
+
+template<int N, int Mode>
+int MSMatrix<N, Mode>::markConflicts(char *param_conflict_out) {
+
+	bool right_diag = !semi_magic && right_diag_sum != magic_const;
+	bool left_diag = !semi_magic && left_diag_sum != magic_const;
+
+	int count = 0;
+
+	for(int i = 0; i < nn; ++i) {
+		int r = cell_row[i];
+		int c = cell_col[i];
+
+		bool conflict = row_sum[r] != magic_const || col_sum[c] != magic_const;
+
+		if(right_diag && r == c)
+			conflict = true;
+		if(left_diag && r + c == n - 1)
+			conflict = true;
+		if(associative && mat[cell_pad[i]] + mat[cell_pad[nn - i - 1]] != associative_const)
+			conflict = true;
+
+		param_conflict_out[i] = conflict;
+		if(conflict)
+			++count;
+	}
+
+	return count;
+
+}
+
+template<int N, int Mode>
+unsigned long long MSMatrix<N, Mode>::canonicalForm(int *param_canonical_out, bool *param_complement_out) {
+
+	//Images are compared cell by cell until they differ, which for
+	//most pairs is at the first cell
+	int best = 0;
+	for(int s = 1; s < 16; ++s) {
+		for(int i = 0; i < nn; ++i) {
+			int a = symmetryValue(s, cell_row[i], cell_col[i]);
+			int b = symmetryValue(best, cell_row[i], cell_col[i]);
+			if(a != b) {
+				if(a < b)
+					best = s;
+				break;
+			}
+		}
+	}
+
+	//FNV-1a over the values, finished by the splitmix64 mixer
+	unsigned long long hash = 14695981039346656037ULL;
+	for(int i = 0; i < nn; ++i) {
+		int value = symmetryValue(best, cell_row[i], cell_col[i]);
+		if(param_canonical_out)
+			param_canonical_out[i] = value;
+		hash = (hash ^ (unsigned long long)value) * 1099511628211ULL;
+	}
+
+	if(param_complement_out)
+		*param_complement_out = (best & 8) != 0;
+
+	return Random::splitMix64(hash);
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::consolePrint() {
+
+	consolePrint(cout);
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::consolePrint(ostream &param_out) {
+
+	for(int i = 0; i < n; ++i) {
+		for(int j = 0; j < n; ++j) {
+			param_out << mat[(i + 1) * stride + j + 1] << "\t";
+		}
+		param_out << endl;
+	}
+
+}
+
+template<int N, int Mode>
+int MSMatrix<N, Mode>::retention() {
+
+	TELEMETRY_COUNT(telemetry, TELEMETRY_RETENTION_FLOOD);
+
+	//Init edges, the corners only touch the padding and other
+	//border cells so they are never queued:
+	for(int i = 0; i < n; ++i) {
+		int top = stride + i + 1;
+		int bottom = n * stride + i + 1;
+		int left = (i + 1) * stride + 1;
+		int right = (i + 1) * stride + n;
+
+		w[top] = mat[top];
+		w[bottom] = mat[bottom];
+		w[left] = mat[left];
+		w[right] = mat[right];
+
+		if(i > 0 && i < n - 1) {
+			q->enqueue(top, w[top]);
+			q->enqueue(bottom, w[bottom]);
+			q->enqueue(left, w[left]);
+			q->enqueue(right, w[right]);
+			TELEMETRY_ADD(telemetry, TELEMETRY_ENQUEUE, 4);
+		}
+	}
+
+	//Init middle:
+	for(int i = 2; i < n; ++i) {
+		for(int j = 2; j < n; ++j) {
+			w[i * stride + j] = nn;
+		}
+	}
+
+	while(q->size() > 0) {
+
+		int ind = 0;
+		int val = 0;
+
+		q->dequeue(&ind, &val);
+		TELEMETRY_COUNT(telemetry, TELEMETRY_DEQUEUE);
+
+		drain(ind - 1, val);
+		drain(ind + 1, val);
+		drain(ind - stride, val);
+		drain(ind + stride, val);
+
+	}
+
+	//The padding has level 0 and value 0 and adds nothing
+
+	last_retention = 0;
+
+	for(int i = 0; i < pnn; ++i)
+		last_retention += w[i] - mat[i];
+
+	return last_retention;
+
+}
+
+template<int N, int Mode>
+int MSMatrix<N, Mode>::swapRetentionDelta(int param_index1, int param_index2, int *param_footprint_out) {
+
+	int p1 = cell_pad[param_index1];
+	int p2 = cell_pad[param_index2];
+
+	if(param_footprint_out)
+		param_footprint_out[0] = -1;
+
+	if(w[p1] > mat[p1] && w[p2] > mat[p2]) {
+		if(w[p2] > mat[p1] && w[p1] > mat[p2]) {
+			TELEMETRY_COUNT(telemetry, TELEMETRY_DELTA_SUBMERGED);
+			return 0;
+		}
+	}
+
+	int max_w1 = MAX(w[p1 - 1], w[p1 + 1]);
+	max_w1 = MAX(max_w1, w[p1 - stride]);
+	max_w1 = MAX(max_w1, w[p1 + stride]);
+
+	int max_w2 = MAX(w[p2 - 1], w[p2 + 1]);
+	max_w2 = MAX(max_w2, w[p2 - stride]);
+	max_w2 = MAX(max_w2, w[p2 + stride]);
+
+	//Both cells dry and the lower of the two heights is above every
+	//neighbouring water level: nothing drains through either cell
+	//before or after the swap, so only the two cells change level.
+	if(w[p1] == mat[p1] && w[p2] == mat[p2]) {
+
+		int min_value = MIN(mat[p1], mat[p2]);
+		if(min_value > max_w1 && min_value > max_w2) {
+			TELEMETRY_COUNT(telemetry, TELEMETRY_DELTA_DRY);
+			return 0;
+		}
+
+	}
+
+	int tree_delta = 0;
+	if(merge_tree_valid && mergeTreeSwapDelta(p1, p2, &tree_delta)) {
+		TELEMETRY_COUNT(telemetry, TELEMETRY_DELTA_MERGE_TREE);
+		return tree_delta;
+	}
+
+	TELEMETRY_COUNT(telemetry, TELEMETRY_DELTA_REFLOOD);
+
+	//Re-flood only the basins around the two cells, starting from the
+	//cached water levels. The higher value is moved first, which can
+	//only raise levels, then the lower value, which can only lower them.
+
+	int value1 = mat[p1];
+	int value2 = mat[p2];
+
+	beginWaterJournal();
+
+	if(value1 < value2) {
+		raiseCell(p1, value2);
+		lowerCell(p2, value1);
+	} else {
+		raiseCell(p2, value1);
+		lowerCell(p1, value2);
+	}
+
+	int delta = water_delta;
+
+	//The re-flood read the changed cells, the two swapped cells and
+	//their neighbours
+
+	if(param_footprint_out) {
+		int row_min = MIN(cell_row[param_index1], cell_row[param_index2]);
+		int row_max = MAX(cell_row[param_index1], cell_row[param_index2]);
+		int col_min = MIN(cell_col[param_index1], cell_col[param_index2]);
+		int col_max = MAX(cell_col[param_index1], cell_col[param_index2]);
+
+		for(int i = 0; i < journal_size; ++i) {
+			int row = journal_index[i] / stride - 1;
+			int col = journal_index[i] % stride - 1;
+			if(row < row_min) row_min = row;
+			if(row > row_max) row_max = row;
+			if(col < col_min) col_min = col;
+			if(col > col_max) col_max = col;
+		}
+
+		param_footprint_out[0] = row_min > 0 ? row_min - 1 : 0;
+		param_footprint_out[1] = row_max < n - 1 ? row_max + 1 : n - 1;
+		param_footprint_out[2] = col_min > 0 ? col_min - 1 : 0;
+		param_footprint_out[3] = col_max < n - 1 ? col_max + 1 : n - 1;
+	}
+
+	rollbackWaterJournal();
+
+	mat[p1] = value1;
+	mat[p2] = value2;
+
+	return delta;
+
+}
+
+/**
+ *	Bounds the retention delta of a swap in O(1). The lower cell lo is
+ *	raised to x, the value of the higher cell hi, which is lowered to
+ *	y, the value of lo. Levels after the swap lie between the levels
+ *	after only lowering hi and after only raising lo.
+ *	- Raising lo changes nothing if x <= w[lo], else only cells which
+ *	- drain through lo rise, at most to x. Their levels are at least
+ *	- w[lo] and below x, and they are connected to lo by cells below x
+ *	- (the padding never rises).
+ *	- lo ends at least at x and hi at least at y.
+ *	- Lowering hi changes nothing else if hi is submerged, if hi is dry
+ *	- only the basins next to it drop, each cell to at least y and at
+ *	- least its own value.
+ */
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::swapRetentionBounds(int param_index1, int param_index2, int *param_lower_out, int *param_upper_out) {
+
+	int lo = cell_pad[param_index1];
+	int hi = cell_pad[param_index2];
+
+	if(mat[lo] > mat[hi]) {
+		int tmp = lo;
+		lo = hi;
+		hi = tmp;
+	}
+
+	int x = mat[hi];
+	int y = mat[lo];
+
+	if(x <= w[lo]) {
+		(*param_upper_out) = 0;
+	} else {
+		int neighbours[4] = { lo - 1, lo + 1, lo - stride, lo + stride };
+		bool isolated = true;
+		for(int l = 0; l < 4; ++l) {
+			int level = w[neighbours[l]];
+			if(level > 0 && level < x)
+				isolated = false;
+		}
+
+		if(isolated) {
+			(*param_upper_out) = x - w[lo];
+		} else {
+			int count = level_count_below[x] - level_count_below[w[lo]];
+			int sum = level_sum_below[x] - level_sum_below[w[lo]];
+			(*param_upper_out) = x * count - sum;
+		}
+	}
+
+	int lower = (x - w[lo]) + (y - w[hi]);
+
+	if(w[hi] == mat[hi]) {
+
+		int neighbours[4] = { hi - 1, hi + 1, hi - stride, hi + stride };
+		int seen[4];
+		int seen_count = 0;
+
+		for(int l = 0; l < 4; ++l) {
+			int b = basin[neighbours[l]];
+			if(b < 0)
+				continue;
+
+			bool counted = false;
+			for(int m = 0; m < seen_count; ++m)
+				counted = counted || seen[m] == b;
+			if(counted)
+				continue;
+			seen[seen_count++] = b;
+
+			int drop = basin_spill[b] - y;
+			if(drop <= 0)
+				continue;
+
+			int loss = basin_size[b] * drop;
+			if(loss > basin_retention[b])
+				loss = basin_retention[b];
+			lower -= loss;
+		}
+
+	}
+
+	(*param_lower_out) = lower;
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::beginWaterJournal() {
+
+	++journal_stamp;
+	journal_size = 0;
+	water_delta = 0;
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::rollbackWaterJournal() {
+
+	for(int i = journal_size - 1; i >= 0; --i)
+		w[journal_index[i]] = journal_level[i];
+
+	journal_size = 0;
+	water_delta = 0;
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::setWaterLevel(int param_index, int param_level) {
+
+	if(journal_mark[param_index] != journal_stamp) {
+		journal_mark[param_index] = journal_stamp;
+		journal_index[journal_size] = param_index;
+		journal_level[journal_size] = w[param_index];
+		++journal_size;
+	}
+
+	water_delta += param_level - w[param_index];
+	w[param_index] = param_level;
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::raiseCell(int param_index, int param_value) {
+
+	mat[param_index] = param_value;
+
+	if(w[param_index] >= param_value)
+		return; //Still under water, no level changes
+
+	//Only cells which drain through the raised cell can rise. The
+	//flood reaches each of them from a neighbour with a level at most
+	//its own, so they are connected to the raised cell through cells
+	//of non-decreasing levels below param_value. Collect them and reset
+	//their levels to an upper bound. The padding has level 0 and is
+	//never part of the region. Following only rising levels keeps the
+	//region to the basins upstream of the cell, about 30 of 400 cells
+	//of a swap at n=20 against 170 for every level in [old, new).
+
+	++region_stamp;
+
+	int region_size = 0;
+	region[region_size++] = param_index;
+	region_mark[param_index] = region_stamp;
+
+	for(int k = 0; k < region_size; ++k) {
+		int ind = region[k];
+
+		int neighbours[4] = { ind - 1, ind + 1, ind - stride, ind + stride };
+
+		for(int l = 0; l < 4; ++l) {
+			int nb = neighbours[l];
+			if(region_mark[nb] != region_stamp && w[nb] >= w[ind] && w[nb] < param_value) {
+				region_mark[nb] = region_stamp;
+				region[region_size++] = nb;
+			}
+		}
+	}
+
+	for(int k = 0; k < region_size; ++k)
+		setWaterLevel(region[k], nn);
+
+	//Seed every region cell from its neighbours and re-flood
+
+	for(int k = 0; k < region_size; ++k) {
+		int ind = region[k];
+
+		int min_w = MIN(w[ind - 1], w[ind + 1]);
+		min_w = MIN(min_w, w[ind - stride]);
+		min_w = MIN(min_w, w[ind + stride]);
+
+		int level = MAX(mat[ind], min_w);
+		if(level < w[ind]) {
+			setWaterLevel(ind, level);
+			q->enqueue(ind, level);
+			TELEMETRY_COUNT(telemetry, TELEMETRY_ENQUEUE);
+		}
+	}
+
+	floodJournaled();
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::lowerCell(int param_index, int param_value) {
+
+	mat[param_index] = param_value;
+
+	int min_w = MIN(w[param_index - 1], w[param_index + 1]);
+	min_w = MIN(min_w, w[param_index - stride]);
+	min_w = MIN(min_w, w[param_index + stride]);
+
+	int level = MAX(param_value, min_w);
+
+	if(level >= w[param_index])
+		return; //Level unchanged, nothing new drains through the cell
+
+	setWaterLevel(param_index, level);
+	q->enqueue(param_index, level);
+	TELEMETRY_COUNT(telemetry, TELEMETRY_ENQUEUE);
+
+	floodJournaled();
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::floodJournaled() {
+
+	while(q->size() > 0) {
+
+		int ind = 0;
+		int val = 0;
+
+		q->dequeue(&ind, &val);
+		TELEMETRY_COUNT(telemetry, TELEMETRY_DEQUEUE);
+
+		drainJournaled(ind - 1, val);
+		drainJournaled(ind + 1, val);
+		drainJournaled(ind - stride, val);
+		drainJournaled(ind + stride, val);
+
+	}
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::drain(int param_index, int param_value) {
+
+	int tmp = MAX(mat[param_index], param_value);
+	if(tmp < w[param_index]) {
+		w[param_index] = tmp;
+		q->enqueue(param_index, tmp);
+		TELEMETRY_COUNT(telemetry, TELEMETRY_ENQUEUE);
+	}
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::drainJournaled(int param_index, int param_value) {
+
+	int tmp = MAX(mat[param_index], param_value);
+	if(tmp < w[param_index]) {
+		setWaterLevel(param_index, tmp);
+		q->enqueue(param_index, tmp);
+		TELEMETRY_COUNT(telemetry, TELEMETRY_ENQUEUE);
+	}
+
+}
+
+template<int N, int Mode>
+int MSMatrix<N, Mode>::retentionMergeTree() {
+
+	TELEMETRY_COUNT(telemetry, TELEMETRY_MERGE_TREE_BUILD);
+
+	//Counting sort of the cells by value
+
+	for(int v = 0; v <= nn + 1; ++v)
+		value_count[v] = 0;
+	for(int i = 0; i < nn; ++i)
+		++value_count[mat[cell_pad[i]] + 1];
+	for(int v = 1; v <= nn + 1; ++v)
+		value_count[v] += value_count[v - 1];
+	for(int i = 0; i < nn; ++i)
+		cell_order[value_count[mat[cell_pad[i]]]++] = cell_pad[i];
+
+	//The padding is one drained component rooted at the corner 0,
+	//which has no neighbours inside the matrix
+
+	for(int i = 0; i < pnn; ++i) {
+		uf_parent[i] = 0;
+		basin[i] = -1;
+		spill_count[i] = 0;
+	}
+	uf_size[0] = pnn;
+	uf_drained[0] = true;
+
+	for(int i = 0; i < nn; ++i)
+		uf_parent[cell_pad[i]] = -1;
+
+	for(int k = 0; k < nn; ++k) {
+		int c = cell_order[k];
+
+		int roots[4];
+		int root_count = 0;
+
+		bool drained = false;
+
+		int neighbours[4] = { c - 1, c + 1, c - stride, c + stride };
+
+		for(int l = 0; l < 4; ++l) {
+			if(uf_parent[neighbours[l]] < 0)
+				continue;
+			int r = findRoot(neighbours[l]);
+			bool seen = false;
+			for(int m = 0; m < root_count; ++m)
+				seen = seen || roots[m] == r;
+			if(!seen) {
+				roots[root_count++] = r;
+				drained = drained || uf_drained[r];
+			}
+		}
+
+		uf_parent[c] = c;
+		uf_size[c] = 1;
+		uf_drained[c] = drained;
+		member_first[c] = c;
+		member_last[c] = c;
+		member_next[c] = -1;
+
+		if(drained) {
+			//Every neighbouring component without an outlet spills over c
+			w[c] = mat[c];
+			for(int m = 0; m < root_count; ++m) {
+				if(!uf_drained[roots[m]])
+					drainBasin(roots[m], c);
+			}
+		}
+
+		for(int m = 0; m < root_count; ++m) {
+			int r1 = findRoot(c);
+			int r2 = roots[m];
+			if(uf_size[r1] < uf_size[r2]) {
+				int tmp = r1;
+				r1 = r2;
+				r2 = tmp;
+			}
+			uf_parent[r2] = r1;
+			uf_size[r1] += uf_size[r2];
+			uf_drained[r1] = uf_drained[r1] || uf_drained[r2];
+			if(!uf_drained[r1]) {
+				member_next[member_last[r1]] = member_first[r2];
+				member_last[r1] = member_last[r2];
+			}
+		}
+	}
+
+	last_retention = 0;
+
+	for(int i = 0; i < pnn; ++i)
+		last_retention += w[i] - mat[i];
+
+	//Histogram of the water levels for swapRetentionBounds()
+
+	for(int v = 0; v <= nn + 1; ++v) {
+		level_count_below[v] = 0;
+		level_sum_below[v] = 0;
+	}
+	for(int i = 0; i < nn; ++i) {
+		int level = w[cell_pad[i]];
+		++level_count_below[level + 1];
+		level_sum_below[level + 1] += level;
+	}
+	for(int v = 1; v <= nn + 1; ++v) {
+		level_count_below[v] += level_count_below[v - 1];
+		level_sum_below[v] += level_sum_below[v - 1];
+	}
+
+	merge_tree_valid = true;
+
+	return last_retention;
+
+}
+
+template<int N, int Mode>
+int MSMatrix<N, Mode>::findRoot(int param_index) {
+
+	while(uf_parent[param_index] != param_index) {
+		uf_parent[param_index] = uf_parent[uf_parent[param_index]];
+		param_index = uf_parent[param_index];
+	}
+
+	return param_index;
+
+}
+
+template<int N, int Mode>
+void MSMatrix<N, Mode>::drainBasin(int param_root, int param_spill_cell) {
+
+	int spill = mat[param_spill_cell];
+
+	basin_spill[param_root] = spill;
+	basin_spill_cell[param_root] = param_spill_cell;
+	basin_size[param_root] = uf_size[param_root];
+	++spill_count[param_spill_cell];
+
+	int held = 0;
+
+	for(int c = member_first[param_root]; c >= 0; c = member_next[c]) {
+		w[c] = spill;
+		basin[c] = param_root;
+		held += spill - mat[c];
+	}
+
+	basin_retention[param_root] = held;
+
+}
+
+template<int N, int Mode>
+bool MSMatrix<N, Mode>::mergeTreeSwapDelta(int param_index1, int param_index2, int *param_delta_out) {
+
+	//Neighbouring cells interact through each other's levels
+
+	int diff = param_index1 - param_index2;
+	if(diff == 1 || diff == -1 || diff == stride || diff == -stride)
+		return false;
+
+	int value1 = mat[param_index1];
+	int value2 = mat[param_index2];
+
+	int delta1 = 0;
+	int delta2 = 0;
+
+	if(!mergeTreeCellDelta(param_index1, value2, &delta1))
+		return false;
+	if(!mergeTreeCellDelta(param_index2, value1, &delta2))
+		return false;
+
+	(*param_delta_out) = delta1 + delta2;
+
+	return true;
+
+}
+
+/**
+ *	Level change of a single cell whose value is set to param_value,
+ *	answered from the basin data without re-flooding. Returns false
+ *	unless the change provably leaves every other level and the set
+ *	of submerged cells unchanged, so that two such changes can be
+ *	combined.
+ */
+
+template<int N, int Mode>
+bool MSMatrix<N, Mode>::mergeTreeCellDelta(int param_index, int param_value, int *param_delta_out) {
+
+	int value = mat[param_index];
+	int level = w[param_index];
+
+	(*param_delta_out) = 0;
+
+	if(level > value) {
+		//Submerged cells stay submerged at the same level
+		return param_value <= level;
+	}
+
+	int neighbours[4] = { param_index - 1, param_index + 1, param_index - stride, param_index + stride };
+
+	if(param_value > value) {
+		//A dry cell is raised, which is safe if no neighbour drains
+		//through it, that is every neighbouring level is below it
+		for(int l = 0; l < 4; ++l) {
+			if(w[neighbours[l]] >= value)
+				return false;
+		}
+		(*param_delta_out) = param_value - value;
+		return true;
+	}
+
+	//A dry cell is lowered. It has to stay dry and may not become a
+	//lower outlet for any neighbouring basin. Border cells always
+	//stay dry since the padding next to them has level 0.
+
+	int min_w = MIN(w[neighbours[0]], w[neighbours[1]]);
+	min_w = MIN(min_w, w[neighbours[2]]);
+	min_w = MIN(min_w, w[neighbours[3]]);
+	if(min_w > param_value)
+		return false; //Would be submerged
+
+	for(int l = 0; l < 4; ++l) {
+		int nb = neighbours[l];
+		if(basin[nb] < 0)
+			continue;
+		int outlet = param_value;
+		bool other = false;
+		for(int m = 0; m < 4; ++m) {
+			int nb2 = neighbours[m];
+			if(basin[nb2] == basin[nb])
+				continue;
+			if(!other || w[nb2] < outlet)
+				outlet = w[nb2];
+			other = true;
+		}
+		if(!other || outlet < param_value)
+			outlet = param_value;
+		if(outlet < w[nb])
+			return false;
+	}
+
+	(*param_delta_out) = param_value - value;
+
+	return true;
+
+}
+
+//The runtime specialization and every fixed specialization used by
+//the solver dispatch
+
+template class MSMatrix<>;
+
+#define MS_INSTANTIATE_FIXED_MATRIX(DIM) \
+	template class MSMatrix<DIM, MS_MODE_NORMAL>; \
+	template class MSMatrix<DIM, MS_MODE_ASSOCIATIVE>; \
+	template class MSMatrix<DIM, MS_MODE_SEMI_MAGIC>;
+
+MS_FOR_EACH_FIXED_DIMENSION(MS_INSTANTIATE_FIXED_MATRIX)
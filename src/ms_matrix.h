@@ -1,82 +1,368 @@
-
-/**
- *	Water Retention on Magic Squares Solver
- *
- *	Author: Johan Öfverstedt
- *	Modified: July 2012
- *	Version 0.12a
- *
- *	ms_matrix.h
- *	Magic Square Matrix Implementation with Water Retention
- *	Algorithm to calculate the Water Retention value and delta
- *
- *	Project website:
- *	sourceforge.net/projects/wrmssolver
- *
- *	Based on thesis:
- *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
- *
- */
- 
-#ifndef _MS_MATRIX_H_
-#define _MS_MATRIX_H_
-
-#include "minpriorityqueue.h"
-
-class MSMatrix {
-public:
-	MSMatrix(unsigned int param_n, bool param_associative, bool param_semi_magic);
-	~MSMatrix();
-
-	void randomRestart();
-	void doSwap(int param_index1, int param_index2);
-
-	int getStoredViolation() { return cur_violation; }
-	int violation();
-
-	int swapDelta(int param_index1, int param_index2);
-
-	int getValue(int param_index) { return mat[param_index]; }
-	void setValue(int param_index, int param_value) { mat[param_index] = param_value; }
-	int getN() { return n; }
-
-	void consolePrint();
-
-	/*** Water retention releated: *** */
-
-	int getLastRetention() { return last_retention; }
-
-	int retention();
-	int swapRetentionDelta(int param_index1, int param_index2);
-	void loadWaterLevels();	
-	void saveWaterLevels();	
-
-	//Sub procedures
-	void drain(int param_index, int param_value);
-
-protected:
-	int n;
-	int nn;
-	int *mat;
-
-	int magic_const;
-	int associative_const;
-
-	bool associative;
-	bool semi_magic;
-
-	int cur_violation;
-	int *row_sum;
-	int *col_sum;
-	int right_diag_sum;
-	int left_diag_sum;
-
-	//Water retention related
-
-	int *w; //Water levels
-	int *w_saved; //Saved water levels
-	MinPriorityQueue *q; //Priority queue
-	int last_retention; //Last retention value
-};
-
-#endif
\ No newline at end of file
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	ms_matrix.h
+ *	Magic Square Matrix Implementation with Water Retention
+ *	Algorithm to calculate the Water Retention value and delta
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+ 
+#ifndef _MS_MATRIX_H_
+#define _MS_MATRIX_H_
+
+#include <stddef.h>
+#include <iostream>
+#include "minpriorityqueue.h"
+#include "random.h"
+#include "telemetry.h"
+
+//Compare the incrementally updated violation and sums with a full
+//recompute after every swap
+#ifdef _DEBUG
+#define CHECK_INCREMENTAL_VIOLATION
+#endif
+
+//Values and water levels are stored in 16 bits, which limits the
+//dimension to 255. Define WIDE_CELL_STORAGE for larger squares.
+//#define WIDE_CELL_STORAGE
+
+#ifdef WIDE_CELL_STORAGE
+typedef int cell_t;
+#define MS_MAX_DIMENSION 1024
+#else
+typedef unsigned short cell_t;
+#define MS_MAX_DIMENSION 255
+#endif
+
+//Constraint modes, the mode of MSMatrix<> is chosen at runtime
+enum {
+	MS_MODE_RUNTIME = -1,
+	MS_MODE_NORMAL = 0,
+	MS_MODE_ASSOCIATIVE = 1,
+	MS_MODE_SEMI_MAGIC = 2
+};
+
+//Dimensions with a compiled specialization for every mode, other
+//dimensions use MSMatrix<>
+#define MS_FOR_EACH_FIXED_DIMENSION(X) \
+	X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16)
+
+/**
+ *	Dimension and constraint mode of a matrix, compile time constants
+ *	for a fixed dimension so loop bounds are known and the branches
+ *	on the constraint mode are removed.
+ */
+
+template<int N, int Mode>
+struct MSDimensions {
+	static const int n = N;
+	static const int nn = N * N;
+	static const int stride = N + 2; //Padded row length
+	static const int pnn = (N + 2) * (N + 2); //Padded cell count
+	static const bool associative = (Mode == MS_MODE_ASSOCIATIVE);
+	static const bool semi_magic = (Mode != MS_MODE_NORMAL);
+
+	void setDimensions(int, bool, bool) {}
+};
+
+template<int Mode>
+struct MSDimensions<0, Mode> {
+	int n;
+	int nn;
+	int stride; //Padded row length
+	int pnn; //Padded cell count
+	bool associative;
+	bool semi_magic;
+
+	void setDimensions(int param_n, bool param_associative, bool param_semi_magic) {
+		n = param_n;
+		nn = n * n;
+		stride = n + 2;
+		pnn = stride * stride;
+		associative = param_associative;
+		semi_magic = param_semi_magic;
+	}
+};
+
+/**
+ *	The matrix is stored row by row with a padding ring of dry cells
+ *	at level 0 around it, (n + 2) * (n + 2) cells in total, so that
+ *	the water retention kernels can step to any neighbour without
+ *	bounds checks. The public interface uses unpadded indices in
+ *	[0, n * n), the water retention sub procedures padded ones.
+ *	MSMatrix<> takes its dimension and mode from the constructor,
+ *	MSMatrix<N, Mode> ignores them.
+ */
+
+template<int N = 0, int Mode = MS_MODE_RUNTIME>
+class MSMatrix : protected MSDimensions<N, Mode> {
+public:
+
+	MSMatrix(unsigned int param_n, bool param_associative, bool param_semi_magic);
+	MSMatrix(const MSMatrix &param_other);
+	~MSMatrix();
+
+	//randomRestart() draws from the random stream of the matrix
+	void randomRestart();
+
+	//Restarts from a constructed magic square of the mode: Siamese for
+	//odd n, the complement construction for doubly even n and the LUX
+	//method for singly even n. It is randomized by transformations
+	//which keep it magic and, in the associative mode, associative.
+	//Returns false and leaves the square unchanged if the dimension and
+	//mode have no construction, there are no associative squares of
+	//singly even order and no magic squares of order 2.
+	bool constructiveRestart();
+	void seedRandom(unsigned long long param_seed) { random.seed(param_seed); }
+	Random &getRandom() { return random; }
+
+	//Kernel counters of this matrix, only counted with SEARCH_TELEMETRY
+	TelemetryCounters &getTelemetry() { return telemetry; }
+	void copyState(const MSMatrix &param_other);
+	void doSwap(int param_index1, int param_index2);
+
+	//Tentative moves. beginMove() needs the water levels of
+	//retention() or retentionMergeTree(), applySwap() then swaps two
+	//cells and updates the sums, the violation and the water levels
+	//incrementally, up to n * n swaps per move. commitMove() keeps the
+	//move, rollbackMove() restores only the cells, sums and levels the
+	//move changed and leaves the merge tree as valid as it was.
+	//swapRetentionDelta() can not be used inside a move and the merge
+	//tree is invalid after a commit.
+	void beginMove();
+	void applySwap(int param_index1, int param_index2);
+	int getMoveRetention() { return last_retention + water_delta; }
+	void commitMove();
+	void rollbackMove();
+
+	//Line moves exchange whole rows and columns and keep every sum of
+	//a magic square. In the semi-magic mode a move exchanges two rows
+	//or two columns, in the other modes the rows and the columns l1
+	//and l2 together with n - 1 - l1 and n - 1 - l2, or l1 and
+	//n - 1 - l1, which also keeps the diagonals and the associative
+	//pairs. Doing a move again undoes it. getLineMoveLines() gives the
+	//lines l1 and l2, rows in [0, n) and columns in [n, 2n), the rows
+	//stand for the columns as well outside the semi-magic mode.
+	int getLineMoveCount();
+	void getLineMoveLines(int param_move, int *param_lines_out);
+	void doLineMove(int param_move);
+
+	//doSwap keeps the stored violation up to date, violation()
+	//recomputes it and is needed after setValue()
+	int getStoredViolation() { return cur_violation; }
+	int violation();
+#ifdef CHECK_INCREMENTAL_VIOLATION
+	void checkViolation();
+#endif
+
+	int swapDelta(int param_index1, int param_index2);
+
+	//Cycles of param_count distinct cells, the cell param_cells[k]
+	//takes the value of param_cells[k + 1] and the last cell the value
+	//of the first. A swap is a cycle of two cells, a 3-cycle or the
+	//rotation of a row or column segment by one are compound moves.
+	//cycleDelta() is the change of the violation, cycleDeltas() that
+	//of param_moves cycles, cycle m made of the cells from
+	//param_starts[m] to param_starts[m + 1] - 1 of param_cells. It reads
+	//the sums once for the whole batch. doCycle() makes a cycle with
+	//doSwap(), applyCycle() with applySwap() inside a move.
+	int cycleDelta(const int *param_cells, int param_count);
+	void cycleDeltas(const int *param_cells, const int *param_starts, int param_moves, int *param_deltas_out);
+	void doCycle(const int *param_cells, int param_count);
+	void applyCycle(const int *param_cells, int param_count);
+
+	//Marks the cells of every row, column, diagonal and associative
+	//pair which violates its constraint, returns the number marked
+	int markConflicts(char *param_conflict_out);
+
+	//Canonical form of the square under its 16 symmetries, the 8
+	//rotations and reflections each with and without the complement
+	//x -> n * n + 1 - x, which all keep a square magic. It is the
+	//smallest image in row major order. Returns a hash of it, copies it
+	//to param_canonical_out if given and tells if it is an image of
+	//the complement. Squares with the same canonical form and
+	//complement flag are rotations or reflections of each other and
+	//have the same retention.
+	unsigned long long canonicalForm(int *param_canonical_out, bool *param_complement_out);
+
+	int getValue(int param_index) { return mat[cell_pad[param_index]]; }
+	int getWaterLevel(int param_index) { return w[cell_pad[param_index]]; }
+	void setValue(int param_index, int param_value) { mat[cell_pad[param_index]] = param_value; merge_tree_valid = false; }
+	int getN() { return n; }
+	bool isAssociative() { return associative; }
+
+	void consolePrint();
+	void consolePrint(std::ostream &param_out);
+
+	/*** Water retention releated: *** */
+
+	int getLastRetention() { return last_retention; }
+
+	int retention();
+	int retentionMergeTree();
+	//If param_footprint_out is given it receives the rows and columns
+	//{ min row, max row, min col, max col } of every cell a re-flood
+	//read, the delta only changes if one of them changes. The min row
+	//is -1 if the delta came from the merge tree or an early exit.
+	int swapRetentionDelta(int param_index1, int param_index2, int *param_footprint_out = 0);
+
+	//Lower and upper bound of swapRetentionDelta() from the cached
+	//water levels and basins, needs retentionMergeTree()
+	void swapRetentionBounds(int param_index1, int param_index2, int *param_lower_out, int *param_upper_out);
+
+	int getBasin(int param_index) { return basin[cell_pad[param_index]]; }
+	int getBasinSpill(int param_basin) { return basin_spill[param_basin]; }
+	int getBasinSize(int param_basin) { return basin_size[param_basin]; }
+
+protected:
+	using MSDimensions<N, Mode>::n;
+	using MSDimensions<N, Mode>::nn;
+	using MSDimensions<N, Mode>::stride;
+	using MSDimensions<N, Mode>::pnn;
+	using MSDimensions<N, Mode>::associative;
+	using MSDimensions<N, Mode>::semi_magic;
+
+	size_t layoutStorage(char *param_base);
+
+	//Updates the sums and the violation for a swap, before the cells
+	//are swapped
+	void updateSums(int param_index1, int param_index2);
+
+	//Violation delta of a cycle, the excess of line l over the magic
+	//constant is looked up in param_line_excess if it is given, lines
+	//are numbered rows, columns, right and left diagonal
+	int cycleViolationDelta(const int *param_cells, int param_count, const int *param_line_excess);
+	int lineSum(int param_line);
+
+	void decodeLineMove(int param_move, int *param_line1_out, int *param_line2_out, bool *param_columns_out);
+	void exchangeRows(int param_row1, int param_row2);
+	void exchangeColumns(int param_col1, int param_col2);
+
+	//Constructions of constructiveRestart(), fill param_square_out
+	//with a magic square of order param_n in row major order
+	static void siameseSquare(int param_n, int *param_square_out);
+	static void complementSquare(int param_n, int *param_square_out);
+	static void luxSquare(int param_n, int *param_square_out);
+
+	//Value at param_row, param_col of the image of the square under
+	//symmetry param_symmetry in [0, 16), bit 0 transposes, bit 1 and 2
+	//flip the rows and the columns and bit 3 complements
+	int symmetryValue(int param_symmetry, int param_row, int param_col) {
+		int r = (param_symmetry & 1) ? param_col : param_row;
+		int c = (param_symmetry & 1) ? param_row : param_col;
+		if(param_symmetry & 2)
+			r = n - 1 - r;
+		if(param_symmetry & 4)
+			c = n - 1 - c;
+		int value = mat[(r + 1) * stride + c + 1];
+		return (param_symmetry & 8) ? nn + 1 - value : value;
+	}
+
+	//Sub procedures, the indices are padded
+	void drain(int param_index, int param_value);
+
+	//Incremental re-flood, every changed water level is journaled
+	//so the levels can be rolled back after a tentative swap
+	void beginWaterJournal();
+	void rollbackWaterJournal();
+	void raiseCell(int param_index, int param_value);
+	void lowerCell(int param_index, int param_value);
+	void setWaterLevel(int param_index, int param_level);
+	void floodJournaled();
+	void drainJournaled(int param_index, int param_value);
+
+	//Merge tree sub procedures
+	int findRoot(int param_index);
+	void drainBasin(int param_root, int param_spill_cell);
+	bool mergeTreeSwapDelta(int param_index1, int param_index2, int *param_delta_out);
+	bool mergeTreeCellDelta(int param_index, int param_value, int *param_delta_out);
+
+	char *storage; //Every array below except the queue lives here
+	size_t storage_size; //Bytes used from the aligned start, at mat
+
+	cell_t *mat; //Padded matrix
+	int *cell_pad; //Padded index of every cell
+	short *cell_row; //Row of every cell
+	short *cell_col; //Column of every cell
+
+	int magic_const;
+	int associative_const;
+
+	Random random;
+	TelemetryCounters telemetry;
+
+	int cur_violation;
+	int *row_sum;
+	int *col_sum;
+	int right_diag_sum;
+	int left_diag_sum;
+
+	//Water retention related
+
+	cell_t *w; //Water levels, padded
+	MinPriorityQueue *q; //Priority queue
+	int last_retention; //Last retention value
+
+	int *journal_index; //Cells changed since beginWaterJournal()
+	cell_t *journal_level; //Their levels before the first change
+	int *journal_mark; //Equals journal_stamp if the cell is journaled
+	int journal_size;
+	int journal_stamp;
+	int water_delta; //Sum of level changes since beginWaterJournal()
+
+	int *move_log; //Cell pairs swapped since beginMove()
+	int move_swaps;
+	bool move_merge_tree_valid; //merge_tree_valid at beginMove()
+
+	//Scratch of the cycle deltas, 2 * n + 2 lines and n * n cells
+	int *line_excess; //Sum less the magic constant, per batch
+	int *line_change; //Change of the sum of each touched line
+	int *line_mark; //Equals cycle_stamp if the line is touched
+	int *cycle_lines; //Touched lines
+	int *cycle_mark; //Equals cycle_stamp if the cell is in the cycle
+	int *cycle_value; //Value of each cell of the cycle after it
+	int cycle_stamp;
+
+	int *region; //Cells affected by a raised cell
+	int *region_mark;
+	int region_stamp;
+
+	//Merge tree retention engine. Cells are added in increasing
+	//order of value and joined with their added neighbours. When a
+	//component without an outlet meets the border at a cell, it
+	//becomes a basin which spills at the value of that cell.
+
+	bool merge_tree_valid; //Basin data matches the current matrix
+	int *value_count; //Counting sort buckets, size nn + 2
+	int *cell_order; //Cells sorted by value
+	int *uf_parent; //Union-find parent, -1 if not yet added
+	int *uf_size;
+	bool *uf_drained; //Root has an outlet to the border
+	int *member_first; //Member list of each undrained root
+	int *member_last;
+	int *member_next;
+	int *basin; //Basin of each cell, -1 if dry
+	int *basin_spill; //Spill height of each basin
+	int *basin_spill_cell; //Cell each basin spills over
+	int *basin_size; //Number of cells in each basin
+	int *spill_count; //Number of basins spilling over each cell
+	int *basin_retention; //Water held by each basin
+
+	//Retention bounds, the number and sum of the water levels below
+	//each level in [0, nn + 1]
+	int *level_count_below;
+	int *level_sum_below;
+};
+
+#endif
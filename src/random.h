@@ -0,0 +1,105 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	random.h
+ *	Random number stream, every matrix owns one so that concurrent
+ *	runs do not share the state of rand()
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#ifndef _RANDOM_H_
+#define _RANDOM_H_
+
+/**
+ *	xoshiro256** generator seeded through splitmix64, so that close
+ *	seeds give unrelated streams. next() returns the high 32 bits of
+ *	a step. nextInt() samples [0, bound) without the bias of a modulo
+ *	by Lemire's multiply and reject method, which almost never needs
+ *	more than one step.
+ */
+
+class Random {
+public:
+	Random(unsigned long long param_seed = 1) { seed(param_seed); }
+
+	void seed(unsigned long long param_seed) {
+		unsigned long long x = param_seed;
+		for(int i = 0; i < 4; ++i)
+			state[i] = splitMix64(x);
+	}
+
+	unsigned long long next64() {
+		unsigned long long result = rotate(state[1] * 5, 7) * 9;
+		unsigned long long t = state[1] << 17;
+
+		state[2] ^= state[0];
+		state[3] ^= state[1];
+		state[1] ^= state[2];
+		state[0] ^= state[3];
+		state[2] ^= t;
+		state[3] = rotate(state[3], 45);
+
+		return result;
+	}
+
+	unsigned int next() { return (unsigned int)(next64() >> 32); }
+
+	//Uniform in [0, param_bound)
+	int nextInt(int param_bound) {
+		unsigned int bound = (unsigned int)param_bound;
+		unsigned long long m = (unsigned long long)next() * bound;
+		unsigned int low = (unsigned int)m;
+		if(low < bound) {
+			unsigned int threshold = (0u - bound) % bound;
+			while(low < threshold) {
+				m = (unsigned long long)next() * bound;
+				low = (unsigned int)m;
+			}
+		}
+		return (int)(m >> 32);
+	}
+
+	//Uniform in [0, 1) with 53 random bits
+	double nextDouble() { return (double)(next64() >> 11) * (1.0 / 9007199254740992.0); }
+
+	//Advances param_state and returns the next splitmix64 output
+	static unsigned long long splitMix64(unsigned long long &param_state) {
+		unsigned long long z = (param_state += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+protected:
+	static unsigned long long rotate(unsigned long long param_x, int param_k) {
+		return (param_x << param_k) | (param_x >> (64 - param_k));
+	}
+
+	unsigned long long state[4];
+};
+
+/**
+ *	Seed of run param_run of a job with the given seed, so that a run
+ *	gives the same result whichever thread executes it.
+ */
+
+inline unsigned long long runSeed(unsigned long long param_seed, int param_run) {
+
+	unsigned long long x = param_seed ^ ((unsigned long long)param_run * 0xD1B54A32D192ED03ULL);
+
+	return Random::splitMix64(x);
+
+}
+
+#endif
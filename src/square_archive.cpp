@@ -0,0 +1,145 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	square_archive.cpp
+ *	Set of the magic squares a run has visited, up to symmetry
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#include "square_archive.h"
+
+#define SQUARE_ARCHIVE_INITIAL_CAPACITY 1024
+
+SquareArchive::SquareArchive() {
+
+	capacity = SQUARE_ARCHIVE_INITIAL_CAPACITY;
+	entries = new Entry[capacity];
+	clear();
+
+}
+
+SquareArchive::~SquareArchive() {
+
+	delete[] entries;
+
+}
+
+void SquareArchive::clear() {
+
+	for(size_t i = 0; i < capacity; ++i)
+		entries[i].key = 0;
+	used = 0;
+
+}
+
+const SquareArchive::Entry *SquareArchive::find(unsigned long long param_key) {
+
+	unsigned long long key = slotKey(param_key);
+
+	for(size_t i = (size_t)key & (capacity - 1); entries[i].key != 0; i = (i + 1) & (capacity - 1)) {
+		if(entries[i].key == key)
+			return &entries[i];
+	}
+
+	return 0;
+
+}
+
+bool SquareArchive::insert(unsigned long long param_key, bool param_complement, int param_retention) {
+
+	unsigned long long key = slotKey(param_key);
+
+	size_t i = (size_t)key & (capacity - 1);
+	while(entries[i].key != 0 && entries[i].key != key)
+		i = (i + 1) & (capacity - 1);
+
+	if(entries[i].key == 0) {
+		if(used >= SQUARE_ARCHIVE_MAX_ENTRIES)
+			return false;
+
+		//At most half full, so probe sequences stay short
+		if(2 * (used + 1) > capacity) {
+			grow();
+			return insert(param_key, param_complement, param_retention);
+		}
+
+		entries[i].key = key;
+		entries[i].retention[0] = -1;
+		entries[i].retention[1] = -1;
+		++used;
+	}
+
+	entries[i].retention[param_complement ? 1 : 0] = param_retention;
+
+	return true;
+
+}
+
+void SquareArchive::grow() {
+
+	Entry *old_entries = entries;
+	size_t old_capacity = capacity;
+
+	capacity *= 2;
+	entries = new Entry[capacity];
+	for(size_t i = 0; i < capacity; ++i)
+		entries[i].key = 0;
+
+	for(size_t i = 0; i < old_capacity; ++i) {
+		if(old_entries[i].key == 0)
+			continue;
+		size_t j = (size_t)old_entries[i].key & (capacity - 1);
+		while(entries[j].key != 0)
+			j = (j + 1) & (capacity - 1);
+		entries[j] = old_entries[i];
+	}
+
+	delete[] old_entries;
+
+}
+
+void SquareArchive::save(CheckpointWriter &param_writer) {
+
+	param_writer.put(used);
+
+	for(size_t i = 0; i < capacity; ++i) {
+		if(entries[i].key != 0)
+			param_writer.put(entries[i]);
+	}
+
+}
+
+bool SquareArchive::load(CheckpointReader &param_reader) {
+
+	clear();
+
+	size_t count = 0;
+	if(!param_reader.get(count) || count > SQUARE_ARCHIVE_MAX_ENTRIES)
+		return false;
+
+	for(size_t k = 0; k < count; ++k) {
+		Entry entry;
+		if(!param_reader.get(entry)) {
+			clear();
+			return false;
+		}
+		for(int c = 0; c < 2; ++c) {
+			if(entry.retention[c] >= 0)
+				insert(entry.key, c == 1, entry.retention[c]);
+		}
+	}
+
+	return true;
+
+}
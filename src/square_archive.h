@@ -0,0 +1,79 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	square_archive.h
+ *	Set of the magic squares a run has visited, up to symmetry
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#ifndef _SQUARE_ARCHIVE_H_
+#define _SQUARE_ARCHIVE_H_
+
+#include <stddef.h>
+#include "checkpoint.h"
+
+//Squares kept at most, 16 bytes each, later squares are not added
+#define SQUARE_ARCHIVE_MAX_ENTRIES (1 << 22)
+
+/**
+ *	Open addressing hash set keyed by the hash of the canonical form
+ *	of a square, see MSMatrix::canonicalForm(). Every entry holds the
+ *	retention of the square and of its complement, which differ, -1
+ *	until it is known. The full 64-bit hash is the key, two distinct
+ *	squares are taken as one only if their hashes collide.
+ */
+
+class SquareArchive {
+public:
+	SquareArchive();
+	~SquareArchive();
+
+	void clear();
+
+	//Retention stored for the square, -1 if it is not in the archive
+	int lookup(unsigned long long param_key, bool param_complement) {
+		const Entry *entry = find(param_key);
+		return entry ? entry->retention[param_complement ? 1 : 0] : -1;
+	}
+
+	//Returns false if the archive is full
+	bool insert(unsigned long long param_key, bool param_complement, int param_retention);
+
+	//Distinct squares up to symmetry
+	size_t size() { return used; }
+	size_t getBytes() { return capacity * sizeof(Entry); }
+
+	void save(CheckpointWriter &param_writer);
+
+	//Returns false and clears the archive if it can not be read
+	bool load(CheckpointReader &param_reader);
+
+protected:
+	struct Entry {
+		unsigned long long key; //0 for an empty slot
+		int retention[2]; //Of the canonical form and of its complement
+	};
+
+	//0 marks empty slots, so the key 0 is stored as 1
+	static unsigned long long slotKey(unsigned long long param_key) { return param_key ? param_key : 1; }
+
+	const Entry *find(unsigned long long param_key);
+	void grow();
+
+	Entry *entries;
+	size_t capacity; //A power of two
+	size_t used;
+};
+
+#endif
@@ -0,0 +1,133 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	swap_delta_cache.cpp
+ *	Cache of swap retention deltas kept between the iterations of the
+ *	retention search
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#include "swap_delta_cache.h"
+
+SwapDeltaCache::SwapDeltaCache(int param_n) {
+
+	n = param_n;
+	nn = n * n;
+
+	//As many slots per row as cells if they fit, else the largest
+	//power of two which fits, at least 16
+
+	row_bits = 0;
+	while((1 << row_bits) < nn)
+		++row_bits;
+
+	direct = true;
+	while(row_bits > 4 && ((size_t)nn << row_bits) * sizeof(Entry) > SWAP_DELTA_CACHE_MAX_BYTES) {
+		--row_bits;
+		direct = false;
+	}
+
+	entries = (size_t)nn << row_bits;
+	table = new Entry[entries];
+
+	cell_changed = new int[nn];
+	row_changed = new int[n];
+	last_value = new int[nn];
+	last_level = new int[nn];
+
+	clear();
+
+}
+
+SwapDeltaCache::~SwapDeltaCache() {
+
+	delete[] table;
+	delete[] cell_changed;
+	delete[] row_changed;
+	delete[] last_value;
+	delete[] last_level;
+
+}
+
+void SwapDeltaCache::clear() {
+
+	for(size_t i = 0; i < entries; ++i)
+		table[i].index2 = -1;
+
+	for(int i = 0; i < nn; ++i) {
+		cell_changed[i] = 0;
+		last_value[i] = -1;
+		last_level[i] = -1;
+	}
+
+	for(int i = 0; i < n; ++i)
+		row_changed[i] = 0;
+
+}
+
+void SwapDeltaCache::setCell(int param_index, int param_value, int param_level, int param_iteration) {
+
+	if(last_value[param_index] == param_value && last_level[param_index] == param_level)
+		return;
+
+	last_value[param_index] = param_value;
+	last_level[param_index] = param_level;
+
+	cell_changed[param_index] = param_iteration;
+	row_changed[param_index / n] = param_iteration;
+
+}
+
+bool SwapDeltaCache::lookup(int param_index1, int param_index2, int *param_delta_out) {
+
+	const Entry &e = table[slot(param_index1, param_index2)];
+
+	if(e.index2 != param_index2)
+		return false;
+
+	//Valid if no cell in the footprint changed after it was computed
+
+	for(int row = e.footprint[0]; row <= e.footprint[1]; ++row) {
+		if(row_changed[row] <= e.iteration)
+			continue;
+		const int *changed = cell_changed + row * n;
+		for(int col = e.footprint[2]; col <= e.footprint[3]; ++col) {
+			if(changed[col] > e.iteration)
+				return false;
+		}
+	}
+
+	(*param_delta_out) = e.delta;
+
+	return true;
+
+}
+
+void SwapDeltaCache::store(int param_index1, int param_index2, int param_delta, int param_iteration, const int *param_footprint) {
+
+	Entry &e = table[slot(param_index1, param_index2)];
+
+	e.index2 = param_index2;
+	e.delta = param_delta;
+	e.iteration = param_iteration;
+	for(int i = 0; i < 4; ++i)
+		e.footprint[i] = (short)param_footprint[i];
+
+}
+
+size_t SwapDeltaCache::getBytes() {
+
+	return entries * sizeof(Entry) + (size_t)nn * 3 * sizeof(int) + n * sizeof(int);
+
+}
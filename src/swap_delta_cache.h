@@ -0,0 +1,86 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	swap_delta_cache.h
+ *	Cache of swap retention deltas kept between the iterations of the
+ *	retention search
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#ifndef _SWAP_DELTA_CACHE_H_
+#define _SWAP_DELTA_CACHE_H_
+
+#include <stddef.h>
+
+//Memory above which the rows get fewer slots than cells
+#define SWAP_DELTA_CACHE_MAX_BYTES (16 << 20)
+
+/**
+ *	Every delta is stored with the iteration it was computed in and
+ *	the box of cells its re-flood read. It stays valid until the value
+ *	or the water level of a cell in the box changes, which setCell()
+ *	records once per iteration for every cell.
+ *	Every row i1 has a power of two slots. If there are at least nn
+ *	the slot of i2 is i2, else i2 is hashed and a new delta evicts the
+ *	one in its slot. Threads may store deltas of different rows
+ *	concurrently.
+ */
+
+class SwapDeltaCache {
+public:
+	SwapDeltaCache(int param_n);
+	~SwapDeltaCache();
+
+	void clear();
+
+	//Records the value and the water level of every cell at the start
+	//of an iteration, before any lookup
+	void setCell(int param_index, int param_value, int param_level, int param_iteration);
+
+	bool lookup(int param_index1, int param_index2, int *param_delta_out);
+	void store(int param_index1, int param_index2, int param_delta, int param_iteration, const int *param_footprint);
+
+	size_t getBytes();
+
+protected:
+	struct Entry {
+		int index2; //-1 if empty
+		int delta;
+		int iteration;
+		short footprint[4]; //Min row, max row, min col, max col
+	};
+
+	size_t slot(int param_index1, int param_index2) {
+		if(direct)
+			return ((size_t)param_index1 << row_bits) + param_index2;
+		return ((size_t)param_index1 << row_bits) + (((unsigned int)param_index2 * 0x9E3779B1u) >> (32 - row_bits));
+	}
+
+	int n;
+	int nn;
+
+	bool direct; //Slot of i2 is i2
+	int row_bits;
+	size_t entries;
+	Entry *table;
+
+	//Last iteration the value or level of each cell and of any cell of
+	//each row changed
+	int *cell_changed;
+	int *row_changed;
+	int *last_value;
+	int *last_level;
+};
+
+#endif
@@ -0,0 +1,160 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	swap_tabu_list.cpp
+ *	Compact tabu memory of the swaps made tabu by the retention search
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#include "swap_tabu_list.h"
+
+SwapTabuList::SwapTabuList(int param_nn) {
+
+	nn = param_nn;
+	base = 0;
+	max_tenure = 65535 - SWAP_TABU_REBASE_INTERVAL;
+
+	size_t triangle = (size_t)nn * (nn - 1) / 2;
+
+	slot_index = 0;
+	row_start = 0;
+
+	if(triangle * sizeof(unsigned short) <= SWAP_TABU_MAX_BYTES) {
+
+		hashed = false;
+		entries = triangle;
+		row_bits = 0;
+
+		row_start = new size_t[nn];
+		size_t start = 0;
+		for(int i = 0; i < nn; ++i) {
+			row_start[i] = start;
+			start += nn - i - 1;
+		}
+
+	} else {
+
+		//The largest power of two slots per row which fits, at least 16
+		hashed = true;
+		size_t slot_bytes = sizeof(unsigned short) + sizeof(int);
+		row_bits = 4;
+		while(((size_t)nn << (row_bits + 1)) * slot_bytes <= SWAP_TABU_MAX_BYTES)
+			++row_bits;
+		entries = (size_t)nn << row_bits;
+
+		slot_index = new int[entries];
+
+	}
+
+	stamp = new unsigned short[entries];
+
+	clear();
+
+}
+
+SwapTabuList::~SwapTabuList() {
+
+	delete[] stamp;
+	if(slot_index)
+		delete[] slot_index;
+	if(row_start)
+		delete[] row_start;
+
+}
+
+void SwapTabuList::clear() {
+
+	base = 0;
+
+	for(size_t i = 0; i < entries; ++i)
+		stamp[i] = 0;
+
+	if(slot_index) {
+		for(size_t i = 0; i < entries; ++i)
+			slot_index[i] = -1;
+	}
+
+}
+
+void SwapTabuList::advance(int param_iteration) {
+
+	int shift = param_iteration - base;
+	if(shift < SWAP_TABU_REBASE_INTERVAL)
+		return;
+
+	//Move the base to the current iteration, expired stamps become 0
+
+	for(size_t i = 0; i < entries; ++i)
+		stamp[i] = stamp[i] > shift ? (unsigned short)(stamp[i] - shift) : 0;
+
+	base = param_iteration;
+
+}
+
+size_t SwapTabuList::getBytes() {
+
+	size_t bytes = entries * sizeof(unsigned short);
+
+	if(slot_index)
+		bytes += entries * sizeof(int);
+	if(row_start)
+		bytes += nn * sizeof(size_t);
+
+	return bytes;
+
+}
+
+void SwapTabuList::save(CheckpointWriter &param_writer) {
+
+	param_writer.put(nn);
+	param_writer.put(hashed);
+	param_writer.put(row_bits);
+	param_writer.put(base);
+
+	param_writer.write(stamp, entries * sizeof(unsigned short));
+	if(slot_index)
+		param_writer.write(slot_index, entries * sizeof(int));
+
+}
+
+bool SwapTabuList::load(CheckpointReader &param_reader) {
+
+	int saved_nn = 0;
+	bool saved_hashed = false;
+	int saved_row_bits = 0;
+	int saved_base = 0;
+
+	param_reader.get(saved_nn);
+	param_reader.get(saved_hashed);
+	param_reader.get(saved_row_bits);
+	param_reader.get(saved_base);
+
+	if(!param_reader.isValid() || saved_nn != nn || saved_hashed != hashed || saved_row_bits != row_bits) {
+		clear();
+		return false;
+	}
+
+	base = saved_base;
+	param_reader.read(stamp, entries * sizeof(unsigned short));
+	if(slot_index)
+		param_reader.read(slot_index, entries * sizeof(int));
+
+	if(!param_reader.isValid()) {
+		clear();
+		return false;
+	}
+
+	return true;
+
+}
@@ -0,0 +1,110 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	swap_tabu_list.h
+ *	Compact tabu memory of the swaps made tabu by the retention search
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#ifndef _SWAP_TABU_LIST_H_
+#define _SWAP_TABU_LIST_H_
+
+#include <stddef.h>
+#include "checkpoint.h"
+
+//Memory above which the swaps are hashed into a fixed number of slots
+//per row instead of stored one by one
+#define SWAP_TABU_MAX_BYTES (8 << 20)
+
+//Iterations between rebasing the stamps, the tenure is at most
+//65535 - SWAP_TABU_REBASE_INTERVAL
+#define SWAP_TABU_REBASE_INTERVAL 32768
+
+/**
+ *	Expiry iterations are stored as 16-bit offsets from a base
+ *	iteration which advance() moves forward, 0 means not tabu.
+ *	Up to SWAP_TABU_MAX_BYTES the upper triangle of swaps (i1 < i2)
+ *	is packed row by row. Above it every row has a power of two slots,
+ *	each holding one i2 of the row, and a swap hashed to an occupied
+ *	slot evicts the swap stored there. A forgotten swap is only
+ *	evaluated earlier than the tabu rule asks for, no swap is ever
+ *	reported tabu by mistake.
+ *	Threads may set swaps of different rows concurrently.
+ */
+
+class SwapTabuList {
+public:
+	SwapTabuList(int param_nn);
+	~SwapTabuList();
+
+	void clear();
+
+	//Call once per iteration before the swaps of the iteration are
+	//looked up
+	void advance(int param_iteration);
+
+	bool isTabu(int param_index1, int param_index2, int param_iteration) {
+		if(hashed) {
+			size_t slot = rowSlot(param_index1, param_index2);
+			return slot_index[slot] == param_index2 && stamp[slot] > param_iteration - base;
+		}
+		return stamp[triangleIndex(param_index1, param_index2)] > param_iteration - base;
+	}
+
+	//The swap stays tabu until iteration param_iteration + param_tenure
+	void setTabu(int param_index1, int param_index2, int param_iteration, int param_tenure) {
+		if(param_tenure > max_tenure)
+			param_tenure = max_tenure;
+		unsigned short s = (unsigned short)(param_iteration + param_tenure - base);
+		if(hashed) {
+			size_t slot = rowSlot(param_index1, param_index2);
+			slot_index[slot] = param_index2;
+			stamp[slot] = s;
+		} else {
+			stamp[triangleIndex(param_index1, param_index2)] = s;
+		}
+	}
+
+	bool isHashed() { return hashed; }
+	size_t getBytes();
+
+	void save(CheckpointWriter &param_writer);
+
+	//Returns false and clears the list if the saved list has another
+	//layout or can not be read
+	bool load(CheckpointReader &param_reader);
+
+protected:
+	size_t triangleIndex(int param_index1, int param_index2) {
+		return row_start[param_index1] + (param_index2 - param_index1 - 1);
+	}
+
+	size_t rowSlot(int param_index1, int param_index2) {
+		return ((size_t)param_index1 << row_bits) + (((unsigned int)param_index2 * 0x9E3779B1u) >> (32 - row_bits));
+	}
+
+	int nn;
+	int base; //Iteration the stamps are relative to
+	int max_tenure;
+
+	bool hashed;
+	size_t entries;
+	int row_bits; //Slots per row are 1 << row_bits when hashed
+
+	unsigned short *stamp;
+	int *slot_index; //i2 stored in each slot when hashed
+	size_t *row_start; //First entry of each row in the triangle
+};
+
+#endif
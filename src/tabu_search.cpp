@@ -0,0 +1,191 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	tabu_search.cpp
+ *	The checkpoints and the buffers of the retention search
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#include "tabu_search.h"
+
+bool saveRetentionState(const char *param_path, int param_n, const int *param_square, const Random &param_random, const RetentionState &param_state) {
+
+	int n = param_n;
+	int nn = n * n;
+
+	CheckpointWriter writer(param_path);
+
+	writer.put(n);
+	writer.write(param_square, nn * sizeof(int));
+	writer.put(param_random);
+
+	writer.put(param_state.it);
+	writer.put(param_state.weight);
+	writer.put(param_state.best_retention);
+	writer.put(param_state.last_improvement);
+	writer.put(param_state.total_evaluated);
+	writer.put(param_state.total_pruned);
+	writer.put(param_state.total_cached);
+	writer.write(param_state.best_mat, nn * sizeof(int));
+	writer.write(param_state.tabulist, nn * sizeof(int));
+	param_state.swap_tabulist->save(writer);
+	writer.put(param_state.revisits);
+	writer.put(param_state.total_feasible);
+	writer.put(param_state.total_revisits);
+	writer.write(param_state.line_tabulist, 2 * n * sizeof(int));
+	writer.put(param_state.total_magic_evaluated);
+	writer.put(param_state.total_magic_moves);
+	writer.put(param_state.total_compound_evaluated);
+	writer.put(param_state.total_compound_moves);
+	if(param_state.archive)
+		param_state.archive->save(writer);
+
+	if(!writer.commit()) {
+		std::cerr << "Could not write checkpoint " << param_path << "." << std::endl;
+		return false;
+	}
+
+	return true;
+
+}
+
+bool loadRetentionState(const char *param_path, int param_n, int *param_square_out, Random *param_random_out, RetentionState &param_state) {
+
+	int n = param_n;
+	int nn = n * n;
+
+	CheckpointReader reader(param_path);
+	if(!reader.isOpen())
+		return false;
+
+	int saved_n = 0;
+	reader.get(saved_n);
+	if(saved_n != n) {
+		std::cerr << "Checkpoint " << param_path << " is of another dimension, the run starts over." << std::endl;
+		return false;
+	}
+
+	int *values = new int[nn];
+	int *best_mat = new int[nn];
+	int *tabulist = new int[nn];
+	int *line_tabulist = new int[2 * n];
+	Random random;
+	RetentionState state = param_state;
+
+	reader.read(values, nn * sizeof(int));
+	reader.get(random);
+	reader.get(state.it);
+	reader.get(state.weight);
+	reader.get(state.best_retention);
+	reader.get(state.last_improvement);
+	reader.get(state.total_evaluated);
+	reader.get(state.total_pruned);
+	reader.get(state.total_cached);
+	reader.read(best_mat, nn * sizeof(int));
+	reader.read(tabulist, nn * sizeof(int));
+
+	bool valid = reader.isValid() && param_state.swap_tabulist->load(reader);
+
+	reader.get(state.revisits);
+	reader.get(state.total_feasible);
+	reader.get(state.total_revisits);
+	reader.read(line_tabulist, 2 * n * sizeof(int));
+	reader.get(state.total_magic_evaluated);
+	reader.get(state.total_magic_moves);
+	reader.get(state.total_compound_evaluated);
+	reader.get(state.total_compound_moves);
+	if(param_state.archive)
+		valid = valid && param_state.archive->load(reader);
+	valid = valid && reader.isValid();
+
+	if(valid) {
+		for(int i = 0; i < nn; ++i) {
+			param_square_out[i] = values[i];
+			param_state.best_mat[i] = best_mat[i];
+			param_state.tabulist[i] = tabulist[i];
+		}
+		for(int i = 0; i < 2 * n; ++i)
+			param_state.line_tabulist[i] = line_tabulist[i];
+		(*param_random_out) = random;
+
+		param_state.it = state.it;
+		param_state.weight = state.weight;
+		param_state.best_retention = state.best_retention;
+		param_state.last_improvement = state.last_improvement;
+		param_state.total_evaluated = state.total_evaluated;
+		param_state.total_pruned = state.total_pruned;
+		param_state.total_cached = state.total_cached;
+		param_state.revisits = state.revisits;
+		param_state.total_feasible = state.total_feasible;
+		param_state.total_revisits = state.total_revisits;
+		param_state.total_magic_evaluated = state.total_magic_evaluated;
+		param_state.total_magic_moves = state.total_magic_moves;
+		param_state.total_compound_evaluated = state.total_compound_evaluated;
+		param_state.total_compound_moves = state.total_compound_moves;
+	} else {
+		if(param_state.archive)
+			param_state.archive->clear();
+		std::cerr << "Checkpoint " << param_path << " could not be read, the run starts over." << std::endl;
+	}
+
+	delete[] values;
+	delete[] best_mat;
+	delete[] line_tabulist;
+	delete[] tabulist;
+
+	return valid;
+
+}
+
+RetentionBuffers::RetentionBuffers(int param_n, int param_threads) {
+
+	int nn = param_n * param_n;
+	best_mat = new int[nn];
+	elite_mat = new int[nn];
+	tabulist = new int[nn];
+	line_tabulist = new int[2 * param_n];
+	swap_tabulist = new SwapTabuList(nn);
+	delta_cache = 0;
+	archive = 0;
+	compound_batch = 0;
+	conflict = new char[nn];
+	conflict_cells = new int[nn];
+	conflict_after = new int[nn];
+	best_moves = new ScanMove[param_threads];
+	best_magic_moves = new MagicMove[param_threads];
+	best_compound_moves = new ScanMove[param_threads];
+
+}
+
+RetentionBuffers::~RetentionBuffers() {
+
+	delete[] best_mat;
+	delete[] elite_mat;
+	delete[] tabulist;
+	delete[] line_tabulist;
+	delete swap_tabulist;
+	if(delta_cache)
+		delete delta_cache;
+	if(archive)
+		delete archive;
+	if(compound_batch)
+		delete compound_batch;
+	delete[] conflict;
+	delete[] conflict_cells;
+	delete[] conflict_after;
+	delete[] best_moves;
+	delete[] best_magic_moves;
+	delete[] best_compound_moves;
+
+}
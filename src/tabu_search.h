@@ -0,0 +1,1453 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	tabu_search.h
+ *	The tabu searches of the solver, the naive algorithm and the
+ *	retention algorithm from the thesis, extended with an improvement
+ *	discovered after the thesis was finished. The retention algorithm
+ *	implements a second tabu list which lets all bad swaps found tabu
+ *	for O(n^2) iterations since if they are bad moves one iteration,
+ *	they are not likely to be good the next.
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#ifndef _TABU_SEARCH_H_
+#define _TABU_SEARCH_H_
+
+#include <iostream>
+#include <sstream>
+#include "ms_matrix.h"
+#include "threads.h"
+#include "elite_pool.h"
+#include "swap_tabu_list.h"
+#include "swap_delta_cache.h"
+#include "square_archive.h"
+#include "checkpoint.h"
+#include "anytime_log.h"
+#include "compound_moves.h"
+
+/**
+ *	Conflict neighbourhood: only swaps with at least one cell in a
+ *	violated row, column, diagonal or associative pair can lower the
+ *	violation. Lists the conflict cells in increasing order and for
+ *	every cell the position in the list of the first conflict cell
+ *	after it. Returns the number of conflict cells.
+ */
+
+template<class Matrix>
+int buildConflictLists(Matrix *param_mat, char *param_conflict, int *param_conflict_cells, int *param_conflict_after) {
+
+	int nn = param_mat->getN() * param_mat->getN();
+
+	param_mat->markConflicts(param_conflict);
+
+	int count = 0;
+	for(int i = 0; i < nn; ++i) {
+		param_conflict_after[i] = count + (param_conflict[i] ? 1 : 0);
+		if(param_conflict[i])
+			param_conflict_cells[count++] = i;
+	}
+
+	return count;
+
+}
+
+/**
+ *	The Naive Algorithm Implementation
+ *	- With param_conflict_neighbourhood only swaps with a conflict
+ *	- cell are evaluated.
+ */
+
+template<class Matrix>
+int tabuNaive(Matrix *param_mat, int param_tabulength, int param_iterations, bool param_terminate_on_first_solution, bool param_conflict_neighbourhood) {
+	
+	int it = 0;
+
+	int n = param_mat->getN();
+	int nn = n * n;
+	int nn_minus_one = nn - 1;
+
+	int *tabulist = new int[nn];
+
+	for(int i = 0; i < nn; ++i)
+		tabulist[i] = 0;
+
+	char *conflict = new char[nn];
+	int *conflict_cells = new int[nn];
+	int *conflict_after = new int[nn];
+
+	param_mat->violation();
+
+	while((param_mat->getStoredViolation() > 0 || !param_terminate_on_first_solution) && it < param_iterations) {
+
+		int best_delta = -1;
+		int sel_ind1 = -1;
+		int sel_ind2 = -1;
+
+		bool restricted = param_conflict_neighbourhood && param_mat->getStoredViolation() > 0;
+		int conflict_count = 0;
+		if(restricted)
+			conflict_count = buildConflictLists(param_mat, conflict, conflict_cells, conflict_after);
+
+		for(int i1 = 0; i1 < nn_minus_one; ++i1) {
+			if(tabulist[i1] > it)
+				continue;
+
+			//Outside the conflict cells i1 only pairs with the conflict
+			//cells after it
+			bool all = !restricted || conflict[i1];
+			int end = all ? nn : conflict_count;
+
+			for(int k = all ? i1 + 1 : conflict_after[i1]; k < end; ++k) {
+				int i2 = all ? k : conflict_cells[k];
+
+				if(tabulist[i2] > it)
+					continue;
+
+				int delta = param_mat->swapDelta(i1, i2);
+
+				if(sel_ind1 == -1 || best_delta > delta) {
+					sel_ind1 = i1;
+					sel_ind2 = i2;
+					best_delta = delta;
+				} else if(delta == best_delta) {
+					if(param_mat->getRandom().nextInt(10) < 2) {
+						sel_ind1 = i1;
+						sel_ind2 = i2;
+						best_delta = delta;
+					}
+				}
+
+			}
+		}
+
+		if(sel_ind1 != -1) {
+			param_mat->doSwap(sel_ind1, sel_ind2);
+		}
+
+		++it;
+		if(sel_ind1 != -1) {
+			tabulist[sel_ind1] = it + param_tabulength;
+			tabulist[sel_ind2]= it + param_tabulength;
+		}
+
+	}
+
+	std::cout << "Iterations: " << it << std::endl;
+
+	delete[] tabulist;
+	delete[] conflict;
+	delete[] conflict_cells;
+	delete[] conflict_after;
+
+	if(param_mat->getStoredViolation() > 0)
+		return -1;
+
+	int ret = param_mat->retention();
+	
+	//Return retention;
+	return ret;
+
+}
+
+/**
+ *	Best move found by one thread of the neighbourhood scan and the
+ *	number of swaps it evaluated, padded to a cache line of its own.
+ */
+
+struct ScanMove {
+	float delta;
+	unsigned int key; //Tie-break key of the move
+	int ind1;
+	int ind2;
+	int evaluated; //Exact swapRetentionDelta() calls
+	int pruned; //Swaps skipped by the retention bounds
+	int cached; //Deltas taken from the delta cache
+	int tabu; //Swaps skipped by the tabu lists
+	char padding[32];
+};
+
+/**
+ *	Tie-break key of a swap in the iteration with the given seed. Ties
+ *	are broken by the key instead of by the scan order so the selected
+ *	move does not depend on how the scan is split between threads.
+ */
+
+inline unsigned int swapKey(unsigned int param_seed, int param_index1, int param_index2) {
+
+	unsigned int h = param_seed ^ ((unsigned int)param_index1 * 0x9E3779B1u) ^ ((unsigned int)param_index2 * 0x85EBCA77u);
+
+	h ^= h >> 16;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35u;
+	h ^= h >> 16;
+
+	return h;
+
+}
+
+//True if the move is selected over param_best, a strict total order
+inline bool betterMove(float param_delta, unsigned int param_key, int param_index1, int param_index2, const ScanMove &param_best) {
+
+	if(param_best.ind1 == -1 || param_delta < param_best.delta)
+		return true;
+	if(param_delta > param_best.delta)
+		return false;
+	if(param_key != param_best.key)
+		return param_key < param_best.key;
+	if(param_index1 != param_best.ind1)
+		return param_index1 < param_best.ind1;
+	return param_index2 < param_best.ind2;
+
+}
+
+/**
+ *	Shared state of the neighbourhood scan of one tabuRetention
+ *	iteration. Thread t evaluates the rows i1 with i1 % threads == t
+ *	on mats[t], its own copy of the matrix with its own water levels
+ *	and queue. Every swap belongs to one row, so the threads never
+ *	write the same swap tabu entry.
+ */
+
+template<class Matrix>
+struct RetentionScan {
+	Matrix **mats;
+	int threads;
+	int n;
+	int it;
+	int tabulength;
+	float weight;
+	unsigned int seed;
+	int *tabulist;
+	SwapTabuList *swap_tabulist;
+	ScanMove *best; //Best move of each thread
+	bool bounds; //Skip swaps whose retention bounds can not win
+	SwapDeltaCache *delta_cache; //NULL if every delta is recomputed
+
+	//Conflict neighbourhood, conflict is NULL if every swap is scanned
+	char *conflict;
+	int *conflict_cells;
+	int *conflict_after;
+	int conflict_count;
+};
+
+template<class Matrix>
+void scanRetentionMoves(void *param_arg, int param_thread) {
+
+	RetentionScan<Matrix> *scan = (RetentionScan<Matrix>*)param_arg;
+
+	Matrix *mat = scan->mats[param_thread];
+
+	int n = scan->n;
+	int nn = n * n;
+	int nn_minus_one = nn - 1;
+	int it = scan->it;
+	int *tabulist = scan->tabulist;
+	SwapTabuList *swap_tabulist = scan->swap_tabulist;
+
+	ScanMove best;
+	best.delta = 0.0f;
+	best.key = 0;
+	best.ind1 = -1;
+	best.ind2 = -1;
+
+	int evaluated = 0;
+	int pruned = 0;
+	int cached = 0;
+	int tabu = 0;
+
+	SwapDeltaCache *delta_cache = scan->delta_cache;
+
+	char *conflict = scan->conflict;
+
+	for(int i1 = param_thread; i1 < nn_minus_one; i1 += scan->threads) {
+
+		//Outside the conflict cells i1 only pairs with the conflict
+		//cells after it
+		bool all = !conflict || conflict[i1];
+		int start = all ? i1 + 1 : scan->conflict_after[i1];
+		int end = all ? nn : scan->conflict_count;
+
+		if(tabulist[i1] > it) {
+			tabu += end - start;
+			continue;
+		}
+
+		for(int k = start; k < end; ++k) {
+			int i2 = all ? k : scan->conflict_cells[k];
+
+			if(tabulist[i2] > it) {
+				++tabu;
+				continue;
+			}
+
+			//If swap is tabu, skip it *** IMPROVEMENT 
+			if(swap_tabulist->isTabu(i1, i2, it)) {
+				++tabu;
+				continue;
+			}
+
+			float delta = (float)mat->swapDelta(i1, i2);
+
+			//Skip the swap if even the largest retention gain can not
+			//beat the best move, unless it might be made tabu below
+			if(scan->bounds && best.ind1 != -1) {
+				int lower, upper;
+				mat->swapRetentionBounds(i1, i2, &lower, &upper);
+				if(lower >= -n) {
+					float bound;
+					if(it % 10 < 5) {
+						bound = 0.1f * delta + scan->weight * (float)(-upper);
+					} else {
+						bound = delta + scan->weight * (float)(-upper);
+					}
+					if(bound > best.delta) {
+						++pruned;
+						continue;
+					}
+				}
+			}
+
+			int retention_delta;
+			if(delta_cache && delta_cache->lookup(i1, i2, &retention_delta)) {
+				++cached;
+			} else if(delta_cache) {
+				++evaluated;
+				int footprint[4];
+				retention_delta = mat->swapRetentionDelta(i1, i2, footprint);
+				if(footprint[0] >= 0)
+					delta_cache->store(i1, i2, retention_delta, it, footprint);
+			} else {
+				++evaluated;
+				retention_delta = mat->swapRetentionDelta(i1, i2);
+			}
+
+			float water_delta = (float)(-retention_delta);
+
+			//If move is bad, make it tabu for (tabu length) ^ 2 iterations *** IMPROVEMENT 
+			if(water_delta > n)
+				swap_tabulist->setTabu(i1, i2, it, scan->tabulength * scan->tabulength);
+
+			if(it % 10 < 5) {
+				delta = 0.1f * delta + scan->weight * water_delta;
+			} else {
+				delta += scan->weight * water_delta;
+			}
+
+			if(delta <= best.delta || best.ind1 == -1) {
+				unsigned int key = swapKey(scan->seed, i1, i2);
+				if(betterMove(delta, key, i1, i2, best)) {
+					best.delta = delta;
+					best.key = key;
+					best.ind1 = i1;
+					best.ind2 = i2;
+				}
+			}
+
+		}
+	}
+
+	best.evaluated = evaluated;
+	best.pruned = pruned;
+	best.cached = cached;
+	best.tabu = tabu;
+	scan->best[param_thread] = best;
+
+}
+
+/**
+ *	Moves which keep a magic square magic, scanned while the square is
+ *	feasible. Paired swaps exchange two cells in each of two rows, or
+ *	in each of two columns, of a rectangle whose changes of the column,
+ *	or row, sums cancel, in the associative mode together with the
+ *	point reflection of the rectangle. Line moves are those of
+ *	MSMatrix::doLineMove().
+ */
+
+enum MagicMoveKind {
+	MAGIC_MOVE_ROWS,
+	MAGIC_MOVE_COLUMNS,
+	MAGIC_MOVE_LINES
+};
+
+struct MagicMove {
+	float delta;
+	unsigned int key; //Tie-break key of the move
+	int kind; //-1 for no move
+	int swaps; //Swapped pairs in cells, 0 for a line move
+	int cells[8]; //The swapped pairs, or the line move in cells[0]
+	int evaluated; //Retention floods
+	char padding[12];
+};
+
+//True if the move is selected over param_best, a strict total order
+inline bool betterMagicMove(const MagicMove &param_move, const MagicMove &param_best) {
+
+	if(param_best.kind == -1 || param_move.delta < param_best.delta)
+		return true;
+	if(param_move.delta > param_best.delta)
+		return false;
+	if(param_move.key != param_best.key)
+		return param_move.key < param_best.key;
+	if(param_move.kind != param_best.kind)
+		return param_move.kind < param_best.kind;
+	for(int k = 0; k < 3; ++k) {
+		if(param_move.cells[k] != param_best.cells[k])
+			return param_move.cells[k] < param_best.cells[k];
+	}
+	return false;
+
+}
+
+//Does the move, or undoes it, every move is its own inverse
+template<class Matrix>
+void doMagicMove(Matrix *param_mat, const MagicMove &param_move) {
+
+	if(param_move.kind == MAGIC_MOVE_LINES) {
+		param_mat->doLineMove(param_move.cells[0]);
+		return;
+	}
+
+	for(int k = 0; k < param_move.swaps; ++k)
+		param_mat->doSwap(param_move.cells[2 * k], param_move.cells[2 * k + 1]);
+
+}
+
+/**
+ *	Shared state of the scan of the magic moves. Thread t evaluates the
+ *	rectangles with a first row r1 % threads == t and the line moves
+ *	m % threads == t on mats[t].
+ */
+
+template<class Matrix>
+struct MagicScan {
+	Matrix **mats;
+	int threads;
+	int n;
+	int it;
+	float weight;
+	unsigned int seed;
+	int retention; //Of the current square
+	int *tabulist;
+	int *line_tabulist; //Tabu rows and columns of the line moves
+	MagicMove *best; //Best move of each thread
+};
+
+//Evaluates a magic move candidate on param_mat and keeps it in
+//param_best if it is better. A paired swap is evaluated as a move of
+//the matrix, which re-floods only the regions its swaps touch, and
+//needs the water levels of the current square. A line move moves
+//every cell of its lines and is flooded in full, which leaves the
+//water levels of the square it was evaluated on, so the scan
+//evaluates the line moves after the paired swaps.
+template<class Matrix>
+void evaluateMagicMove(MagicScan<Matrix> *param_scan, Matrix *param_mat, MagicMove &param_move, MagicMove &param_best) {
+
+	bool line_move = (param_move.kind == MAGIC_MOVE_LINES);
+
+	if(line_move) {
+		doMagicMove(param_mat, param_move);
+	} else {
+		param_mat->beginMove();
+		for(int k = 0; k < param_move.swaps; ++k)
+			param_mat->applySwap(param_move.cells[2 * k], param_move.cells[2 * k + 1]);
+	}
+
+	//The diagonals and the associative pairs of a paired swap are
+	//only known from the violation
+	if(param_mat->getStoredViolation() == 0) {
+		++param_best.evaluated;
+		int retention = line_move ? param_mat->retention() : param_mat->getMoveRetention();
+		param_move.delta = param_scan->weight * (float)(param_scan->retention - retention);
+		param_move.key = swapKey(param_scan->seed ^ (unsigned int)param_move.kind, param_move.cells[0], param_move.cells[1]);
+		if(betterMagicMove(param_move, param_best)) {
+			int evaluated = param_best.evaluated;
+			param_best = param_move;
+			param_best.evaluated = evaluated;
+		}
+	}
+
+	if(line_move)
+		doMagicMove(param_mat, param_move);
+	else
+		param_mat->rollbackMove();
+
+}
+
+template<class Matrix>
+void scanMagicMoves(void *param_arg, int param_thread) {
+
+	MagicScan<Matrix> *scan = (MagicScan<Matrix>*)param_arg;
+
+	Matrix *mat = scan->mats[param_thread];
+
+	int n = scan->n;
+	int nn = n * n;
+	int it = scan->it;
+	int *tabulist = scan->tabulist;
+	bool associative = mat->isAssociative();
+
+	MagicMove best;
+	best.delta = 0.0f;
+	best.key = 0;
+	best.kind = -1;
+	best.evaluated = 0;
+
+	MagicMove move;
+	move.delta = 0.0f;
+	move.key = 0;
+
+	for(int r1 = param_thread; r1 < n - 1; r1 += scan->threads) {
+		for(int r2 = r1 + 1; r2 < n; ++r2) {
+			for(int c1 = 0; c1 < n - 1; ++c1) {
+				for(int c2 = c1 + 1; c2 < n; ++c2) {
+					int i11 = r1 * n + c1;
+					int i12 = r1 * n + c2;
+					int i21 = r2 * n + c1;
+					int i22 = r2 * n + c2;
+
+					if(tabulist[i11] > it || tabulist[i12] > it || tabulist[i21] > it || tabulist[i22] > it)
+						continue;
+
+					int a = mat->getValue(i11);
+					int b = mat->getValue(i12);
+					int c = mat->getValue(i21);
+					int d = mat->getValue(i22);
+
+					for(int kind = MAGIC_MOVE_ROWS; kind <= MAGIC_MOVE_COLUMNS; ++kind) {
+						if(kind == MAGIC_MOVE_ROWS ? a + c != b + d : a + b != c + d)
+							continue;
+
+						move.kind = kind;
+						move.swaps = 2;
+						move.cells[0] = i11;
+						move.cells[1] = kind == MAGIC_MOVE_ROWS ? i12 : i21;
+						move.cells[2] = kind == MAGIC_MOVE_ROWS ? i21 : i12;
+						move.cells[3] = i22;
+
+						if(associative) {
+							//The rectangle and its reflection are one move,
+							//scanned from the one with the first cell
+							if(nn - 1 - i22 <= i11)
+								continue;
+							bool overlap = false;
+							for(int k = 0; k < 4; ++k) {
+								int mirror = nn - 1 - move.cells[k];
+								if(tabulist[mirror] > it)
+									overlap = true;
+								for(int l = 0; l < 4; ++l) {
+									if(mirror == move.cells[l])
+										overlap = true;
+								}
+								move.cells[4 + k] = mirror;
+							}
+							if(overlap)
+								continue;
+							move.swaps = 4;
+						}
+
+						evaluateMagicMove(scan, mat, move, best);
+					}
+				}
+			}
+		}
+	}
+
+	int line_moves = mat->getLineMoveCount();
+
+	for(int m = param_thread; m < line_moves; m += scan->threads) {
+		move.kind = MAGIC_MOVE_LINES;
+		move.swaps = 0;
+		move.cells[0] = m;
+		move.cells[1] = 0;
+		move.cells[2] = 0;
+
+		int lines[2];
+		mat->getLineMoveLines(m, lines);
+		if(scan->line_tabulist[lines[0]] > it || scan->line_tabulist[lines[1]] > it)
+			continue;
+
+		evaluateMagicMove(scan, mat, move, best);
+	}
+
+	scan->best[param_thread] = best;
+
+}
+
+/**
+ *	Shared state of the scan of the compound moves of one iteration.
+ *	The batch is sampled and its violation deltas scored before the
+ *	scan, thread t evaluates the retention of the moves m % threads ==
+ *	t as moves of mats[t]. The best move of a thread is a ScanMove with
+ *	ind1 the index of the move in the batch.
+ */
+
+template<class Matrix>
+struct CompoundScan {
+	Matrix **mats;
+	int threads;
+	int it;
+	float weight;
+	unsigned int seed;
+	int retention; //Of the current square
+	int *tabulist;
+	CompoundBatch *batch;
+	ScanMove *best; //Best move of each thread
+};
+
+template<class Matrix>
+void scanCompoundMoves(void *param_arg, int param_thread) {
+
+	CompoundScan<Matrix> *scan = (CompoundScan<Matrix>*)param_arg;
+
+	Matrix *mat = scan->mats[param_thread];
+	CompoundBatch *batch = scan->batch;
+
+	int it = scan->it;
+	int *tabulist = scan->tabulist;
+
+	ScanMove best;
+	best.delta = 0.0f;
+	best.key = 0;
+	best.ind1 = -1;
+	best.ind2 = -1;
+
+	int evaluated = 0;
+	int tabu = 0;
+
+	int moves = batch->size();
+
+	for(int m = param_thread; m < moves; m += scan->threads) {
+		const int *cells = batch->getCells(m);
+		int count = batch->getCellCount(m);
+
+		bool is_tabu = false;
+		for(int k = 0; k < count; ++k) {
+			if(tabulist[cells[k]] > it)
+				is_tabu = true;
+		}
+		if(is_tabu) {
+			++tabu;
+			continue;
+		}
+
+		++evaluated;
+		mat->beginMove();
+		mat->applyCycle(cells, count);
+		float water_delta = (float)(scan->retention - mat->getMoveRetention());
+		mat->rollbackMove();
+
+		float delta = (float)batch->getViolationDelta(m);
+		if(it % 10 < 5) {
+			delta = 0.1f * delta + scan->weight * water_delta;
+		} else {
+			delta += scan->weight * water_delta;
+		}
+
+		unsigned int key = swapKey(scan->seed ^ 0x5BD1E995u, cells[0], cells[1]);
+		if(betterMove(delta, key, m, -1, best)) {
+			best.delta = delta;
+			best.key = key;
+			best.ind1 = m;
+		}
+	}
+
+	best.evaluated = evaluated;
+	best.pruned = 0;
+	best.cached = 0;
+	best.tabu = tabu;
+	scan->best[param_thread] = best;
+
+}
+
+/**
+ *	Island search settings. A run publishes its best square to the
+ *	elite pool every migration_interval iterations and restarts from
+ *	a perturbed elite after stagnation_limit iterations without a new
+ *	best square, or when a random restart is due.
+ */
+
+struct IslandSettings {
+	ElitePool *elite_pool;
+	int migration_interval;
+	int stagnation_limit;
+};
+
+/**
+ *	Neighbourhood and pruning options of the retention search, see
+ *	tabuRetention()
+ */
+
+struct RetentionOptions {
+	bool conflict_neighbourhood;
+	bool bounds;
+	bool delta_cache;
+	bool constructive_restarts;
+	bool magic_moves;
+	double compound_ratio; //0 for no compound moves
+};
+
+/**
+ *	Restarts from a random permutation, or with param_constructive from
+ *	a constructed magic square if there is one of the dimension and mode
+ */
+
+template<class Matrix>
+void restartSquare(Matrix *param_mat, bool param_constructive) {
+
+	if(!param_constructive || !param_mat->constructiveRestart())
+		param_mat->randomRestart();
+
+}
+
+/**
+ *	Loads an elite of the pool and perturbs it by n / 2 + 1 random
+ *	swaps, or restarts as restartSquare() if the pool is empty.
+ */
+
+template<class Matrix>
+void restartFromElite(Matrix *param_mat, ElitePool *param_elite_pool, int *param_square, bool param_constructive) {
+
+	int n = param_mat->getN();
+	int nn = n * n;
+
+	int retention = -1;
+	if(!param_elite_pool->sample(param_mat->getRandom(), param_square, &retention)) {
+		restartSquare(param_mat, param_constructive);
+		return;
+	}
+
+	for(int i = 0; i < nn; ++i)
+		param_mat->setValue(i, param_square[i]);
+
+	param_mat->violation();
+
+	for(int k = 0; k < n / 2 + 1; ++k) {
+		int i1 = param_mat->getRandom().nextInt(nn);
+		int i2 = param_mat->getRandom().nextInt(nn);
+		if(i1 != i2)
+			param_mat->doSwap(i1, i2);
+	}
+
+}
+
+/**
+ *	Search state of a run besides its square and its random stream,
+ *	everything a checkpoint has to hold to continue the run exactly.
+ */
+
+struct RetentionState {
+	int it;
+	float weight;
+	int best_retention;
+	int last_improvement;
+	long long total_evaluated;
+	long long total_pruned;
+	long long total_cached;
+	int *best_mat;
+	int *tabulist;
+	int *line_tabulist; //2n entries
+	SwapTabuList *swap_tabulist;
+	SquareArchive *archive; //NULL if the run keeps no archive
+	int revisits; //Feasible squares in a row found in the archive
+	long long total_feasible;
+	long long total_revisits;
+	long long total_magic_evaluated;
+	long long total_magic_moves;
+	long long total_compound_evaluated;
+	long long total_compound_moves;
+};
+
+/**
+ *	Checkpoints of a run. The state is saved to path every interval
+ *	seconds and when the run ends. With resume the run continues from
+ *	the checkpoint at path if there is one.
+ */
+
+struct CheckpointSettings {
+	const char *path;
+	double interval;
+	bool resume;
+};
+
+/**
+ *	Archive of the feasible squares of a run. The retention of a
+ *	square already in the archive is looked up instead of computed,
+ *	after revisit_limit feasible squares in a row from the archive the
+ *	run restarts, 0 never restarts.
+ */
+
+struct ArchiveSettings {
+	int revisit_limit;
+};
+
+/**
+ *	Anytime settings of a run. A run with a deadline stops when
+ *	getWallTime() reaches it and returns the best square found so far,
+ *	with a log every new best square is recorded as soon as it is
+ *	found, under the seed and the run number.
+ */
+
+struct AnytimeSettings {
+	double deadline; //0 for no deadline
+	AnytimeLog *log; //NULL for no log
+	unsigned long long seed;
+	int run;
+};
+
+/**
+ *	Telemetry of a run. Every interval iterations a line with the
+ *	counters of the last interval and the state of the search is
+ *	written to out. The kernel counters are only counted in builds
+ *	with SEARCH_TELEMETRY defined.
+ */
+
+struct TelemetrySettings {
+	int interval;
+	int run;
+	std::ostream *out;
+};
+
+/**
+ *	Counters of the search since the last telemetry line
+ */
+
+struct SearchTelemetry {
+	int it;
+	double time;
+	long long evaluated;
+	long long pruned;
+	long long cached;
+	long long tabu;
+	int restarts;
+	int revisits;
+	double merge_tree_time;
+	double scan_time;
+
+	void start(int param_it) {
+		it = param_it;
+		time = getWallTime();
+		evaluated = 0;
+		pruned = 0;
+		cached = 0;
+		tabu = 0;
+		restarts = 0;
+		revisits = 0;
+		merge_tree_time = 0.0;
+		scan_time = 0.0;
+	}
+};
+
+/**
+ *	Writes the telemetry line of the square scanned in iteration
+ *	param_it and starts the next interval. The line is written at
+ *	once so the lines of parallel runs do not interleave.
+ */
+
+template<class Matrix>
+void writeTelemetry(const TelemetrySettings *param_telemetry, SearchTelemetry &param_search, Matrix **param_mats, int param_threads, int param_it, float param_weight, int param_retention, int param_best_retention) {
+
+	TelemetryCounters kernels;
+	for(int t = 0; t < param_threads; ++t) {
+		kernels.add(param_mats[t]->getTelemetry());
+		param_mats[t]->getTelemetry().clear();
+	}
+
+	int iterations = param_it + 1 - param_search.it;
+	double time = getWallTime() - param_search.time;
+
+	std::ostringstream line;
+	line << "telemetry run=" << param_telemetry->run
+		<< " it=" << (param_it + 1)
+		<< " it/s=" << (time > 0.0 ? (double)iterations / time : 0.0)
+		<< " violation=" << param_mats[0]->getStoredViolation()
+		<< " retention=" << param_retention
+		<< " best=" << param_best_retention
+		<< " weight=" << param_weight
+		<< " evaluated=" << param_search.evaluated
+		<< " pruned=" << param_search.pruned
+		<< " cached=" << param_search.cached
+		<< " tabu=" << param_search.tabu
+		<< " restarts=" << param_search.restarts
+		<< " revisits=" << param_search.revisits
+		<< " merge_tree_ms=" << param_search.merge_tree_time * 1000.0
+		<< " scan_ms=" << param_search.scan_time * 1000.0;
+
+#ifdef SEARCH_TELEMETRY
+	long long floods = kernels.count[TELEMETRY_RETENTION_FLOOD] + kernels.count[TELEMETRY_DELTA_REFLOOD];
+	line << " delta_submerged=" << kernels.count[TELEMETRY_DELTA_SUBMERGED]
+		<< " delta_dry=" << kernels.count[TELEMETRY_DELTA_DRY]
+		<< " delta_merge_tree=" << kernels.count[TELEMETRY_DELTA_MERGE_TREE]
+		<< " delta_reflood=" << kernels.count[TELEMETRY_DELTA_REFLOOD]
+		<< " floods=" << kernels.count[TELEMETRY_RETENTION_FLOOD]
+		<< " merge_trees=" << kernels.count[TELEMETRY_MERGE_TREE_BUILD]
+		<< " enqueues/flood=" << (floods > 0 ? (double)kernels.count[TELEMETRY_ENQUEUE] / (double)floods : 0.0)
+		<< " dequeues/flood=" << (floods > 0 ? (double)kernels.count[TELEMETRY_DEQUEUE] / (double)floods : 0.0);
+#endif
+
+	line << std::endl;
+	*param_telemetry->out << line.str();
+	param_telemetry->out->flush();
+
+	param_search.start(param_it + 1);
+
+}
+
+/**
+ *	Scores a feasible square of the run, through the archive if the run
+ *	keeps one, and keeps it in best_mat if it holds more water than the
+ *	best square so far. Returns true for a new best square, which is
+ *	then also recorded in the anytime log.
+ */
+
+template<class Matrix>
+bool scoreFeasibleSquare(Matrix *param_mat, RetentionState &param_state, const AnytimeSettings *param_anytime, SearchTelemetry &param_telemetry) {
+
+	int n = param_mat->getN();
+	int nn = n * n;
+
+	SquareArchive *archive = param_state.archive;
+
+	int retention = -1;
+	if(archive) {
+		bool complement = false;
+		unsigned long long key = param_mat->canonicalForm(0, &complement);
+		retention = archive->lookup(key, complement);
+		++param_state.total_feasible;
+		if(retention >= 0) {
+			++param_state.revisits;
+			++param_state.total_revisits;
+			++param_telemetry.revisits;
+		} else {
+			retention = param_mat->retention();
+			archive->insert(key, complement, retention);
+			param_state.revisits = 0;
+		}
+	} else
+		retention = param_mat->retention();
+
+	if(retention <= param_state.best_retention)
+		return false;
+
+	for(int i = 0; i < nn; ++i) {
+		param_state.best_mat[i] = param_mat->getValue(i);
+	}
+	param_state.best_retention = retention;
+	param_state.last_improvement = param_state.it;
+	if(param_anytime && param_anytime->log)
+		param_anytime->log->record(param_anytime->seed, param_anytime->run, n, retention, param_state.best_mat);
+
+	return true;
+
+}
+
+/**
+ *	Saves the square param_square of dimension param_n, its random
+ *	stream and the state of a run to the checkpoint at param_path.
+ */
+
+bool saveRetentionState(const char *param_path, int param_n, const int *param_square, const Random &param_random, const RetentionState &param_state);
+
+/**
+ *	Restores the square, the random stream and the state of a run from
+ *	its checkpoint. Returns false and leaves everything but the swap
+ *	tabu list and the archive, which are cleared, unchanged if there is
+ *	no checkpoint or it does not belong to a run of this dimension.
+ */
+
+bool loadRetentionState(const char *param_path, int param_n, int *param_square_out, Random *param_random_out, RetentionState &param_state);
+
+/**
+ *	Buffers of tabuRetention for one dimension. A worker allocates
+ *	them once and reuses them for all its runs, and for the runs of
+ *	later jobs of the same dimension.
+ */
+
+struct RetentionBuffers {
+	RetentionBuffers(int param_n, int param_threads);
+	~RetentionBuffers();
+
+	int *best_mat;
+	int *elite_mat; //Scratch square of the restarts and the checkpoints
+	int *tabulist;
+	int *line_tabulist;
+	SwapTabuList *swap_tabulist;
+	SwapDeltaCache *delta_cache; //Allocated by the first run using it
+	SquareArchive *archive; //Allocated by the first run using it
+	CompoundBatch *compound_batch; //Allocated by the first run using it
+	char *conflict;
+	int *conflict_cells;
+	int *conflict_after;
+	ScanMove *best_moves; //One per thread
+	MagicMove *best_magic_moves; //One per thread
+	ScanMove *best_compound_moves; //One per thread
+};
+
+/**
+ *	The Improved Retention Algorithm Implemented
+ *	- The improvements of the algorithm from the version in the thesis
+ *	- are marked by *** IMPROVEMENT comments.
+ *	- The neighbourhood is scanned by the threads of param_pool,
+ *	- param_thread_mats holds one matrix of the same dimension and mode
+ *	- for each thread except the first, which uses param_mat.
+ *	- param_island is NULL unless the run is part of an island search.
+ *	- param_options is NULL for none of the options:
+ *	- With conflict_neighbourhood only swaps with a conflict cell are
+ *	- evaluated while the square violates the constraints.
+ *	- With bounds swaps which can not be selected and would not be
+ *	- made tabu are skipped without computing their retention delta.
+ *	- With delta_cache deltas of re-flooded swaps are reused until a
+ *	- cell they depend on changes.
+ *	- With constructive_restarts random restarts begin at a
+ *	- constructed magic square, see MSMatrix::constructiveRestart().
+ *	- With magic_moves the moves which keep a feasible square magic
+ *	- are scanned as well, and win over a swap with the same score or
+ *	- worse.
+ *	- compound_ratio is the number of compound moves sampled every
+ *	- iteration relative to the swaps of the neighbourhood, see
+ *	- compound_moves.h. A compound move is made if it is better than
+ *	- the best swap.
+ *	- param_checkpoint is NULL unless the run saves checkpoints.
+ *	- param_telemetry is NULL unless the run writes telemetry lines.
+ *	- param_anytime is NULL unless the run has a deadline or a log.
+ *	- param_archive is NULL unless the run keeps an archive of the
+ *	- feasible squares it visits.
+ *	- The buffers of the search are taken from param_buffers.
+ */
+
+template<class Matrix>
+int tabuRetention(Matrix *param_mat,
+	Matrix **param_thread_mats,
+	ThreadPool *param_pool,
+	const IslandSettings *param_island,
+	int param_tabulength,
+	int param_iterations,
+	int param_chance_of_random_restart,
+	bool param_terminate_on_first_solution,
+	const RetentionOptions *param_options,
+	const CheckpointSettings *param_checkpoint,
+	const TelemetrySettings *param_telemetry,
+	const AnytimeSettings *param_anytime,
+	const ArchiveSettings *param_archive,
+	RetentionBuffers *param_buffers,
+	std::ostream &param_out) {
+	
+	RetentionOptions options = { false, false, false, false, false, 0.0 };
+	if(param_options)
+		options = *param_options;
+
+	RetentionState state;
+
+	int &it = state.it;
+	it = 0;
+
+	int n = param_mat->getN();
+	int nn = n * n;
+
+	float &weight = state.weight;
+	weight = 0.5f;
+
+	int &best_retention = state.best_retention;
+	best_retention = -1;
+	int *best_mat = param_buffers->best_mat;
+	state.best_mat = best_mat;
+
+	int &last_improvement = state.last_improvement; //Iteration of the last new best square
+	last_improvement = 0;
+	bool unpublished = false; //best_mat is not in the elite pool yet
+	int *elite_mat = param_buffers->elite_mat;
+
+	int threads = param_pool->getThreadCount();
+
+	int *tabulist = param_buffers->tabulist;
+	state.tabulist = tabulist;
+
+	//Declare the swap tabu list *** IMPROVEMENT 
+	SwapTabuList *swap_tabulist = param_buffers->swap_tabulist;
+	swap_tabulist->clear();
+	state.swap_tabulist = swap_tabulist;
+
+	for(int i = 0; i < nn; ++i)
+		tabulist[i] = 0;
+
+	int *line_tabulist = param_buffers->line_tabulist;
+	state.line_tabulist = line_tabulist;
+	for(int i = 0; i < 2 * n; ++i)
+		line_tabulist[i] = 0;
+
+	Matrix **mats = new Matrix*[threads];
+	mats[0] = param_mat;
+	for(int t = 1; t < threads; ++t)
+		mats[t] = param_thread_mats[t - 1];
+
+	ScanMove *best_moves = param_buffers->best_moves;
+
+	RetentionScan<Matrix> scan;
+	scan.mats = mats;
+	scan.threads = threads;
+	scan.n = n;
+	scan.tabulength = param_tabulength;
+	scan.tabulist = tabulist;
+	scan.swap_tabulist = swap_tabulist;
+	scan.best = best_moves;
+	scan.bounds = options.bounds;
+
+	SwapDeltaCache *delta_cache = 0;
+	if(options.delta_cache) {
+		if(!param_buffers->delta_cache)
+			param_buffers->delta_cache = new SwapDeltaCache(n);
+		delta_cache = param_buffers->delta_cache;
+		delta_cache->clear();
+	}
+	scan.delta_cache = delta_cache;
+
+	//Feasible squares visited, up to symmetry
+	SquareArchive *archive = 0;
+	if(param_archive) {
+		if(!param_buffers->archive)
+			param_buffers->archive = new SquareArchive();
+		archive = param_buffers->archive;
+		archive->clear();
+	}
+	state.archive = archive;
+
+	int &revisits = state.revisits;
+	long long &total_feasible = state.total_feasible;
+	long long &total_revisits = state.total_revisits;
+	revisits = 0;
+	total_feasible = 0;
+	total_revisits = 0;
+
+	MagicMove *best_magic_moves = param_buffers->best_magic_moves;
+
+	MagicScan<Matrix> magic_scan;
+	magic_scan.mats = mats;
+	magic_scan.threads = threads;
+	magic_scan.n = n;
+	magic_scan.tabulist = tabulist;
+	magic_scan.line_tabulist = line_tabulist;
+	magic_scan.best = best_magic_moves;
+
+	long long &total_magic_evaluated = state.total_magic_evaluated;
+	long long &total_magic_moves = state.total_magic_moves;
+	total_magic_evaluated = 0;
+	total_magic_moves = 0;
+
+	//Compound moves sampled per iteration, at least one and few
+	//enough for the batch to be allocated
+	int compound_count = 0;
+	if(options.compound_ratio > 0.0) {
+		double count = options.compound_ratio * (double)nn * (double)(nn - 1) / 2.0 + 0.5;
+		compound_count = count < 1.0 ? 1 : (count > 1000000.0 ? 1000000 : (int)count);
+	}
+
+	CompoundBatch *compound_batch = 0;
+	if(compound_count > 0) {
+		if(!param_buffers->compound_batch)
+			param_buffers->compound_batch = new CompoundBatch(n);
+		compound_batch = param_buffers->compound_batch;
+	}
+
+	ScanMove *best_compound_moves = param_buffers->best_compound_moves;
+
+	CompoundScan<Matrix> compound_scan;
+	compound_scan.mats = mats;
+	compound_scan.threads = threads;
+	compound_scan.tabulist = tabulist;
+	compound_scan.batch = compound_batch;
+	compound_scan.best = best_compound_moves;
+
+	long long &total_compound_evaluated = state.total_compound_evaluated;
+	long long &total_compound_moves = state.total_compound_moves;
+	total_compound_evaluated = 0;
+	total_compound_moves = 0;
+
+	long long &total_evaluated = state.total_evaluated;
+	long long &total_pruned = state.total_pruned;
+	long long &total_cached = state.total_cached;
+	total_evaluated = 0;
+	total_pruned = 0;
+	total_cached = 0;
+
+	char *conflict = param_buffers->conflict;
+	scan.conflict_cells = param_buffers->conflict_cells;
+	scan.conflict_after = param_buffers->conflict_after;
+
+	bool resumed = false;
+	if(param_checkpoint && param_checkpoint->resume) {
+		resumed = loadRetentionState(param_checkpoint->path, n, elite_mat, &param_mat->getRandom(), state);
+		if(resumed) {
+			for(int i = 0; i < nn; ++i)
+				param_mat->setValue(i, elite_mat[i]);
+		}
+	}
+
+	double last_checkpoint = getWallTime();
+
+	SearchTelemetry telemetry;
+	telemetry.start(it);
+	for(int t = 0; t < threads; ++t)
+		mats[t]->getTelemetry().clear();
+
+	param_mat->violation();
+
+	//The starting square may already be feasible, a constructed one
+	//always is. A resumed run scored it before its checkpoint.
+	if(!resumed && param_mat->getStoredViolation() == 0 && scoreFeasibleSquare(param_mat, state, param_anytime, telemetry))
+		unpublished = true;
+
+	while((param_mat->getStoredViolation() > 0 || !param_terminate_on_first_solution) && it < param_iterations) {
+
+		if(param_anytime && param_anytime->deadline > 0.0 && getWallTime() >= param_anytime->deadline)
+			break;
+
+		//Saved between iterations, where the state is complete
+		if(param_checkpoint && getWallTime() - last_checkpoint >= param_checkpoint->interval) {
+			for(int i = 0; i < nn; ++i)
+				elite_mat[i] = param_mat->getValue(i);
+			saveRetentionState(param_checkpoint->path, n, elite_mat, param_mat->getRandom(), state);
+			last_checkpoint = getWallTime();
+		}
+
+		bool restarted = false;
+
+		if(param_island) {
+			if(unpublished && it % param_island->migration_interval == 0) {
+				param_island->elite_pool->publish(best_mat, best_retention);
+				unpublished = false;
+			}
+
+			if(it - last_improvement >= param_island->stagnation_limit) {
+				restartFromElite(param_mat, param_island->elite_pool, elite_mat, options.constructive_restarts);
+				last_improvement = it;
+				++telemetry.restarts;
+				restarted = true;
+			}
+		}
+
+		if(param_chance_of_random_restart > 0 && param_mat->getRandom().nextInt(param_chance_of_random_restart) == 0) {
+			if(param_island)
+				restartFromElite(param_mat, param_island->elite_pool, elite_mat, options.constructive_restarts);
+			else
+				restartSquare(param_mat, options.constructive_restarts);
+			++telemetry.restarts;
+			restarted = true;
+		}
+
+		if(restarted && param_mat->getStoredViolation() == 0 && scoreFeasibleSquare(param_mat, state, param_anytime, telemetry))
+			unpublished = true;
+
+		double time1 = param_telemetry ? getWallTime() : 0.0;
+
+		//Rebuild the merge tree once, swapRetentionDelta looks up
+		//most swaps in it instead of re-flooding
+		int retention = param_mat->retentionMergeTree();
+
+		for(int t = 1; t < threads; ++t)
+			mats[t]->copyState(*param_mat);
+
+		if(delta_cache) {
+			for(int i = 0; i < nn; ++i)
+				delta_cache->setCell(i, param_mat->getValue(i), param_mat->getWaterLevel(i), it);
+		}
+
+		swap_tabulist->advance(it);
+
+		scan.conflict = 0;
+		if(options.conflict_neighbourhood && param_mat->getStoredViolation() > 0) {
+			scan.conflict_count = buildConflictLists(param_mat, conflict, scan.conflict_cells, scan.conflict_after);
+			scan.conflict = conflict;
+		}
+
+		scan.it = it;
+		scan.weight = weight;
+		scan.seed = param_mat->getRandom().next();
+
+		double time2 = param_telemetry ? getWallTime() : 0.0;
+
+		param_pool->run(scanRetentionMoves<Matrix>, &scan);
+
+		//Reduce in thread order, the order is total so the result
+		//is the same for any number of threads
+		ScanMove best = best_moves[0];
+		for(int t = 0; t < threads; ++t) {
+			total_evaluated += best_moves[t].evaluated;
+			total_pruned += best_moves[t].pruned;
+			total_cached += best_moves[t].cached;
+			telemetry.evaluated += best_moves[t].evaluated;
+			telemetry.pruned += best_moves[t].pruned;
+			telemetry.cached += best_moves[t].cached;
+			telemetry.tabu += best_moves[t].tabu;
+		}
+		for(int t = 1; t < threads; ++t) {
+			const ScanMove &m = best_moves[t];
+			if(m.ind1 != -1 && betterMove(m.delta, m.key, m.ind1, m.ind2, best))
+				best = m;
+		}
+
+		//Compound moves around the conflict cells of the square, scanned
+		//before the magic moves since those flood the line moves in
+		//full and leave other water levels behind
+		ScanMove compound;
+		compound.ind1 = -1;
+		if(compound_batch) {
+			int conflict_count = 0;
+			if(param_mat->getStoredViolation() > 0)
+				conflict_count = scan.conflict ? scan.conflict_count : buildConflictLists(param_mat, conflict, scan.conflict_cells, scan.conflict_after);
+			compound_batch->sample(param_mat, scan.conflict_cells, conflict_count, compound_count);
+
+			compound_scan.it = it;
+			compound_scan.weight = weight;
+			compound_scan.seed = scan.seed;
+			compound_scan.retention = retention;
+
+			param_pool->run(scanCompoundMoves<Matrix>, &compound_scan);
+
+			compound = best_compound_moves[0];
+			for(int t = 0; t < threads; ++t)
+				total_compound_evaluated += best_compound_moves[t].evaluated;
+			for(int t = 1; t < threads; ++t) {
+				const ScanMove &m = best_compound_moves[t];
+				if(m.ind1 != -1 && betterMove(m.delta, m.key, m.ind1, m.ind2, compound))
+					compound = m;
+			}
+
+			if(best.ind1 != -1 && compound.delta >= best.delta)
+				compound.ind1 = -1;
+		}
+
+		//A feasible square may also move without leaving the magic
+		//squares, the scan floods every candidate
+		MagicMove magic;
+		magic.kind = -1;
+		if(options.magic_moves && param_mat->getStoredViolation() == 0) {
+			magic_scan.it = it;
+			magic_scan.weight = weight;
+			magic_scan.seed = scan.seed;
+			magic_scan.retention = retention;
+
+			param_pool->run(scanMagicMoves<Matrix>, &magic_scan);
+
+			magic = best_magic_moves[0];
+			for(int t = 0; t < threads; ++t)
+				total_magic_evaluated += best_magic_moves[t].evaluated;
+			for(int t = 1; t < threads; ++t) {
+				const MagicMove &m = best_magic_moves[t];
+				if(m.kind != -1 && betterMagicMove(m, magic))
+					magic = m;
+			}
+
+			if(magic.kind != -1 && compound.ind1 != -1 && magic.delta > compound.delta)
+				magic.kind = -1;
+			else if(magic.kind != -1 && best.ind1 != -1 && magic.delta > best.delta)
+				magic.kind = -1;
+		}
+
+		//Before the swap, the line describes the scanned square
+		if(param_telemetry) {
+			double time3 = getWallTime();
+			telemetry.merge_tree_time += time2 - time1;
+			telemetry.scan_time += time3 - time2;
+			if((it + 1) % param_telemetry->interval == 0)
+				writeTelemetry(param_telemetry, telemetry, mats, threads, it, weight, retention, best_retention);
+		}
+
+		if(magic.kind != -1) {
+			doMagicMove(param_mat, magic);
+			++total_magic_moves;
+		} else if(compound.ind1 != -1) {
+			param_mat->doCycle(compound_batch->getCells(compound.ind1), compound_batch->getCellCount(compound.ind1));
+			++total_compound_moves;
+		} else if(best.ind1 != -1) {
+			param_mat->doSwap(best.ind1, best.ind2);
+		}
+
+		weight *= 0.99f;
+		if(weight < 0.0001f)
+			weight = 0.5f;
+
+		++it;
+		if(magic.kind == MAGIC_MOVE_LINES) {
+			int lines[2];
+			param_mat->getLineMoveLines(magic.cells[0], lines);
+			line_tabulist[lines[0]] = it + param_tabulength;
+			line_tabulist[lines[1]] = it + param_tabulength;
+		} else if(magic.kind != -1) {
+			for(int k = 0; k < 2 * magic.swaps; ++k)
+				tabulist[magic.cells[k]] = it + param_tabulength;
+		} else if(compound.ind1 != -1) {
+			const int *cells = compound_batch->getCells(compound.ind1);
+			for(int k = 0; k < compound_batch->getCellCount(compound.ind1); ++k)
+				tabulist[cells[k]] = it + param_tabulength;
+		} else if(best.ind1 != -1) {
+			tabulist[best.ind1] = it + param_tabulength;
+			tabulist[best.ind2] = it + param_tabulength;
+		}
+
+		if(param_mat->getStoredViolation() == 0) {
+			if(scoreFeasibleSquare(param_mat, state, param_anytime, telemetry))
+				unpublished = true;
+			weight = 0.5f;
+
+			//The search keeps landing on squares it has seen, diversify
+			if(archive && param_archive->revisit_limit > 0 && revisits >= param_archive->revisit_limit) {
+				if(param_island)
+					restartFromElite(param_mat, param_island->elite_pool, elite_mat, options.constructive_restarts);
+				else
+					restartSquare(param_mat, options.constructive_restarts);
+				revisits = 0;
+				++telemetry.restarts;
+				if(param_mat->getStoredViolation() == 0 && scoreFeasibleSquare(param_mat, state, param_anytime, telemetry))
+					unpublished = true;
+			}
+		}
+	}
+
+	if(param_island && unpublished)
+		param_island->elite_pool->publish(best_mat, best_retention);
+
+	//A resumed finished run ends at once with the same result
+	if(param_checkpoint) {
+		for(int i = 0; i < nn; ++i)
+			elite_mat[i] = param_mat->getValue(i);
+		saveRetentionState(param_checkpoint->path, n, elite_mat, param_mat->getRandom(), state);
+	}
+
+	param_out << "Iterations: " << it << std::endl;
+	param_out << "Retention evaluations: " << total_evaluated << ", pruned by bounds: " << total_pruned << ", cached: " << total_cached << std::endl;
+	if(options.magic_moves)
+		param_out << "Magic move evaluations: " << total_magic_evaluated << ", moves made: " << total_magic_moves << std::endl;
+	if(compound_batch)
+		param_out << "Compound move evaluations: " << total_compound_evaluated << ", moves made: " << total_compound_moves << std::endl;
+	if(archive)
+		param_out << "Feasible squares: " << total_feasible << ", revisited: " << total_revisits << ", distinct up to symmetry: " << archive->size() << std::endl;
+
+	if(best_retention > -1) {
+		for(int i = 0; i < nn; ++i) {
+			param_mat->setValue(i, best_mat[i]);
+		}
+	}
+
+	delete[] mats;
+
+	if(best_retention < 0)
+		return -1;
+	
+	//Return retention;
+	return best_retention;
+
+}
+
+#endif
@@ -0,0 +1,65 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	telemetry.h
+ *	Counters of the water retention kernels for the telemetry lines of
+ *	the retention search
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+//Counts the calls of the water retention kernels by path. Off by
+//default since the counters sit on the hottest paths of the solver,
+//without it the telemetry lines only hold the search counters.
+//#define SEARCH_TELEMETRY
+
+enum TelemetryCounter {
+	TELEMETRY_DELTA_SUBMERGED, //swapRetentionDelta, both cells under water
+	TELEMETRY_DELTA_DRY, //swapRetentionDelta, both cells above their neighbours
+	TELEMETRY_DELTA_MERGE_TREE, //swapRetentionDelta answered by the merge tree
+	TELEMETRY_DELTA_REFLOOD, //swapRetentionDelta re-flooded
+	TELEMETRY_RETENTION_FLOOD, //Full retention() floods
+	TELEMETRY_MERGE_TREE_BUILD, //retentionMergeTree() rebuilds
+	TELEMETRY_ENQUEUE,
+	TELEMETRY_DEQUEUE,
+	TELEMETRY_COUNTERS
+};
+
+struct TelemetryCounters {
+	long long count[TELEMETRY_COUNTERS];
+
+	TelemetryCounters() { clear(); }
+
+	void clear() {
+		for(int i = 0; i < TELEMETRY_COUNTERS; ++i)
+			count[i] = 0;
+	}
+
+	void add(const TelemetryCounters &param_other) {
+		for(int i = 0; i < TELEMETRY_COUNTERS; ++i)
+			count[i] += param_other.count[i];
+	}
+};
+
+#ifdef SEARCH_TELEMETRY
+#define TELEMETRY_ADD(COUNTERS, COUNTER, AMOUNT) ((COUNTERS).count[COUNTER] += (AMOUNT))
+#else
+#define TELEMETRY_ADD(COUNTERS, COUNTER, AMOUNT) ((void)0)
+#endif
+
+#define TELEMETRY_COUNT(COUNTERS, COUNTER) TELEMETRY_ADD(COUNTERS, COUNTER, 1)
+
+#endif
@@ -0,0 +1,278 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	threads.cpp
+ *	Minimal threading support on top of the Win32 and POSIX threads
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#include "threads.h"
+
+#ifndef WIN32
+#include <unistd.h>
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+#endif
+
+Mutex::Mutex() {
+
+#ifdef WIN32
+	InitializeCriticalSection(&cs);
+#else
+	pthread_mutex_init(&mutex, 0);
+#endif
+
+}
+
+Mutex::~Mutex() {
+
+#ifdef WIN32
+	DeleteCriticalSection(&cs);
+#else
+	pthread_mutex_destroy(&mutex);
+#endif
+
+}
+
+void Mutex::lock() {
+
+#ifdef WIN32
+	EnterCriticalSection(&cs);
+#else
+	pthread_mutex_lock(&mutex);
+#endif
+
+}
+
+void Mutex::unlock() {
+
+#ifdef WIN32
+	LeaveCriticalSection(&cs);
+#else
+	pthread_mutex_unlock(&mutex);
+#endif
+
+}
+
+ThreadPool::ThreadPool(int param_threads) {
+
+	thread_count = param_threads < 1 ? 1 : param_threads;
+
+	task = 0;
+	task_arg = 0;
+	generation = 0;
+	pending = 0;
+	shutdown = false;
+
+#ifdef WIN32
+	InitializeConditionVariable(&start_condition);
+	InitializeConditionVariable(&done_condition);
+#else
+	pthread_cond_init(&start_condition, 0);
+	pthread_cond_init(&done_condition, 0);
+#endif
+
+	//Thread 0 is the caller of run()
+
+	workers = new Worker[thread_count];
+
+	for(int i = 1; i < thread_count; ++i) {
+		workers[i].pool = this;
+		workers[i].index = i;
+#ifdef WIN32
+		workers[i].handle = CreateThread(0, 0, workerMain, &workers[i], 0, 0);
+#else
+		pthread_create(&workers[i].handle, 0, workerMain, &workers[i]);
+#endif
+	}
+
+}
+
+ThreadPool::~ThreadPool() {
+
+	mutex.lock();
+	shutdown = true;
+	++generation;
+	signalAll();
+	mutex.unlock();
+
+	for(int i = 1; i < thread_count; ++i) {
+#ifdef WIN32
+		WaitForSingleObject(workers[i].handle, INFINITE);
+		CloseHandle(workers[i].handle);
+#else
+		pthread_join(workers[i].handle, 0);
+#endif
+	}
+
+	delete[] workers;
+
+#ifndef WIN32
+	pthread_cond_destroy(&start_condition);
+	pthread_cond_destroy(&done_condition);
+#endif
+
+}
+
+void ThreadPool::run(ThreadTask param_task, void *param_arg) {
+
+	if(thread_count == 1) {
+		param_task(param_arg, 0);
+		return;
+	}
+
+	mutex.lock();
+	task = param_task;
+	task_arg = param_arg;
+	pending = thread_count - 1;
+	++generation;
+	signalAll();
+	mutex.unlock();
+
+	param_task(param_arg, 0);
+
+	mutex.lock();
+	while(pending > 0) {
+#ifdef WIN32
+		SleepConditionVariableCS(&done_condition, &mutex.cs, INFINITE);
+#else
+		pthread_cond_wait(&done_condition, &mutex.mutex);
+#endif
+	}
+	mutex.unlock();
+
+}
+
+void ThreadPool::signalAll() {
+
+#ifdef WIN32
+	WakeAllConditionVariable(&start_condition);
+#else
+	pthread_cond_broadcast(&start_condition);
+#endif
+
+}
+
+#ifdef WIN32
+DWORD WINAPI ThreadPool::workerMain(LPVOID param_worker) {
+#else
+void *ThreadPool::workerMain(void *param_worker) {
+#endif
+
+	Worker *worker = (Worker*)param_worker;
+	ThreadPool *pool = worker->pool;
+
+	int seen_generation = 0;
+
+	while(true) {
+
+		pool->mutex.lock();
+		while(pool->generation == seen_generation) {
+#ifdef WIN32
+			SleepConditionVariableCS(&pool->start_condition, &pool->mutex.cs, INFINITE);
+#else
+			pthread_cond_wait(&pool->start_condition, &pool->mutex.mutex);
+#endif
+		}
+		seen_generation = pool->generation;
+		bool stop = pool->shutdown;
+		ThreadTask current_task = pool->task;
+		void *current_arg = pool->task_arg;
+		pool->mutex.unlock();
+
+		if(stop)
+			break;
+
+		current_task(current_arg, worker->index);
+
+		pool->mutex.lock();
+		if(--pool->pending == 0) {
+#ifdef WIN32
+			WakeConditionVariable(&pool->done_condition);
+#else
+			pthread_cond_signal(&pool->done_condition);
+#endif
+		}
+		pool->mutex.unlock();
+
+	}
+
+	return 0;
+
+}
+
+int ThreadPool::getHardwareThreads() {
+
+#ifdef WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count < 1 ? 1 : (int)count;
+#endif
+
+}
+
+double getWallTime() {
+
+#ifdef WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+#elif defined(__APPLE__)
+	mach_timebase_info_data_t timebase;
+	mach_timebase_info(&timebase);
+	return (double)mach_absolute_time() * timebase.numer / timebase.denom * 1e-9;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+
+}
+
+int atomicIncrement(volatile int *param_value) {
+
+#ifdef WIN32
+	return (int)InterlockedIncrement((volatile LONG*)param_value);
+#else
+	return __sync_add_and_fetch(param_value, 1);
+#endif
+
+}
+
+bool atomicCompareExchange(volatile long long *param_value, long long param_expected, long long param_desired) {
+
+#ifdef WIN32
+	return InterlockedCompareExchange64(param_value, param_desired, param_expected) == param_expected;
+#else
+	return __sync_bool_compare_and_swap(param_value, param_expected, param_desired);
+#endif
+
+}
+
+long long atomicLoad(volatile long long *param_value) {
+
+#ifdef WIN32
+	return InterlockedCompareExchange64(param_value, 0, 0);
+#else
+	return __sync_val_compare_and_swap(param_value, 0, 0);
+#endif
+
+}
@@ -0,0 +1,124 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	threads.h
+ *	Minimal threading support on top of the Win32 and POSIX threads
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#ifndef _THREADS_H_
+#define _THREADS_H_
+
+#ifdef WIN32
+//Condition variables need Windows Vista or later
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+class Mutex {
+public:
+	Mutex();
+	~Mutex();
+
+	void lock();
+	void unlock();
+
+protected:
+	friend class ThreadPool;
+
+#ifdef WIN32
+	CRITICAL_SECTION cs;
+#else
+	pthread_mutex_t mutex;
+#endif
+};
+
+/**
+ *	Task run by every thread of a pool, param_thread is in
+ *	[0, getThreadCount()).
+ */
+
+typedef void (*ThreadTask)(void *param_arg, int param_thread);
+
+/**
+ *	A fixed set of worker threads. run() executes the task once on
+ *	every thread, the calling thread acts as thread 0, and returns
+ *	when all of them are done.
+ */
+
+class ThreadPool {
+public:
+	ThreadPool(int param_threads);
+	~ThreadPool();
+
+	int getThreadCount() { return thread_count; }
+
+	void run(ThreadTask param_task, void *param_arg);
+
+	static int getHardwareThreads();
+
+protected:
+	struct Worker {
+		ThreadPool *pool;
+		int index;
+#ifdef WIN32
+		HANDLE handle;
+#else
+		pthread_t handle;
+#endif
+	};
+
+#ifdef WIN32
+	static DWORD WINAPI workerMain(LPVOID param_worker);
+#else
+	static void *workerMain(void *param_worker);
+#endif
+
+	void signalAll();
+
+	int thread_count;
+	Worker *workers;
+
+	Mutex mutex;
+#ifdef WIN32
+	CONDITION_VARIABLE start_condition;
+	CONDITION_VARIABLE done_condition;
+#else
+	pthread_cond_t start_condition;
+	pthread_cond_t done_condition;
+#endif
+
+	ThreadTask task;
+	void *task_arg;
+	int generation; //Incremented for every run() and on shutdown
+	int pending; //Workers still running the current task
+	bool shutdown;
+};
+
+//Seconds on a monotonic clock, for measuring elapsed wall time
+
+double getWallTime();
+
+//Atomic operations on shared counters, with full barriers
+
+int atomicIncrement(volatile int *param_value);
+bool atomicCompareExchange(volatile long long *param_value, long long param_expected, long long param_desired);
+long long atomicLoad(volatile long long *param_value);
+
+#endif
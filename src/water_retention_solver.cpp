@@ -1,357 +1,1011 @@
-
-/**
- *	Water Retention on Magic Squares Solver
- *
- *	Author: Johan Öfverstedt
- *	Modified: July 2012
- *	Version 0.12a
- *
- *	water_retention_solver.cpp
- *	Water Retention Solver implementing two of the three different
- *	algorithms from the thesis, the naive algorithm and the retention
- *	algorithm extended with an improvement discovered after the thesis
- *	was finished. This solver implements a second tabu list which lets
- *	all bad swaps found tabu for O(n^2) iterations since if they are
- *	bad moves one iteration, they are not likely to be good the next.
- *
- *	Project website:
- *	sourceforge.net/projects/wrmssolver
- *
- *	Based on thesis:
- *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
- *
- */
-
-#include <iostream>
-#include <time.h>
-#include "ms_matrix.h"
-
-#define MAX(x, y) (x) >= (y) ? (x) : (y)
-
-using namespace std;
-
-/**
- *	The Naive Algorithm Implementation
- */
-
-int tabuNaive(MSMatrix *param_mat, int param_tabulength, int param_iterations, bool param_terminate_on_first_solution) {
-	
-	int it = 0;
-
-	int n = param_mat->getN();
-	int nn = n * n;
-	int nn_minus_one = nn - 1;
-
-	int *tabulist = new int[nn];
-
-	for(int i = 0; i < nn; ++i)
-		tabulist[i] = 0;
-
-	while((param_mat->violation() > 0 || !param_terminate_on_first_solution) && it < param_iterations) {
-
-		int best_delta = -1;
-		int sel_ind1 = -1;
-		int sel_ind2 = -1;
-
-		for(int i1 = 0; i1 < nn_minus_one; ++i1) {
-			if(tabulist[i1] > it)
-				continue;
-
-			for(int i2 = i1 + 1; i2 < nn; ++i2) {
-				if(tabulist[i2] > it)
-					continue;
-
-				int delta = param_mat->swapDelta(i1, i2);
-
-				if(sel_ind1 == -1 || best_delta > delta) {
-					sel_ind1 = i1;
-					sel_ind2 = i2;
-					best_delta = delta;
-				} else if(delta == best_delta) {
-					if(rand() % 10 < 2) {
-						sel_ind1 = i1;
-						sel_ind2 = i2;
-						best_delta = delta;
-					}
-				}
-
-			}
-		}
-
-		if(sel_ind1 != -1) {
-			param_mat->doSwap(sel_ind1, sel_ind2);
-			param_mat->violation();
-		}
-
-		++it;
-		tabulist[sel_ind1] = it + param_tabulength;
-		tabulist[sel_ind2]= it + param_tabulength;
-
-	}
-
-	cout << "Iterations: " << it << endl;
-
-	delete[] tabulist;
-
-	if(param_mat->violation() > 0)
-		return -1;
-
-	int ret = param_mat->retention();
-	
-	//Return retention;
-	return ret;
-
-}
-
-/**
- *	The Improved Retention Algorithm Implemented
- *	- The improvements of the algorithm from the version in the thesis
- *	- are marked by *** IMPROVEMENT comments.
- */
-
-int tabuRetention(MSMatrix *param_mat,
-	int param_tabulength,
-	int param_iterations,
-	int param_chance_of_random_restart,
-	bool param_terminate_on_first_solution) {
-	
-	int it = 0;
-
-	int n = param_mat->getN();
-	int nn = n * n;
-	int nn_minus_one = nn - 1;
-
-	float weight = 0.5f;
-
-	int best_retention = -1;
-	int *best_mat = new int[nn];
-
-
-	int *tabulist = new int[nn];
-	if(!tabulist)
-		return -1;
-
-	//Declare the swap tabu list *** IMPROVEMENT 
-	int *swap_tabulist = new int[nn * nn];
-	if(!swap_tabulist) {
-		delete tabulist;
-		return -1;
-	}
-
-	for(int i = 0; i < nn; ++i)
-		tabulist[i] = 0;
-
-	//Initialize the swap tabu list *** IMPROVEMENT 
-	for(int i = 0; i < nn * nn; ++i)
-		swap_tabulist[i] = 0;
-
-	while((param_mat->violation() > 0 || !param_terminate_on_first_solution) && it < param_iterations) {
-
-		if(param_chance_of_random_restart > 0 && (rand() % param_chance_of_random_restart) == 0)
-			param_mat->randomRestart();
-
-		float best_delta = 0.0f;
-		int sel_ind1 = -1;
-		int sel_ind2 = -1;
-
-		param_mat->violation();
-		param_mat->retention();
-		param_mat->saveWaterLevels();
-
-		for(int i1 = 0; i1 < nn_minus_one; ++i1) {
-			if(tabulist[i1] > it)
-				continue;
-
-			for(int i2 = i1 + 1; i2 < nn; ++i2) {
-				if(tabulist[i2] > it)
-					continue;
-
-				//If swap is tabu, skip it *** IMPROVEMENT 
-				if(swap_tabulist[i1 * nn + i2] > it)
-					continue;
-
-				float delta = (float)param_mat->swapDelta(i1, i2);
-				float water_delta = (float)(-param_mat->swapRetentionDelta(i1, i2));
-
-				//If move is bad, make it tabu for (tabu length) ^ 2 iterations *** IMPROVEMENT 
-				if(water_delta > n)
-					swap_tabulist[i1 * nn + i2] = it + param_tabulength * param_tabulength;
-
-				if(it % 10 < 5) {
-					delta = 0.1f * delta + weight * water_delta;
-				} else {
-					delta += weight * water_delta;
-				}
-
-				if(sel_ind1 == -1 || best_delta > delta) {
-					sel_ind1 = i1;
-					sel_ind2 = i2;
-					best_delta = delta;
-				} else if(delta == best_delta) {
-					if(rand() % 10 < 2) {
-						sel_ind1 = i1;
-						sel_ind2 = i2;
-						best_delta = delta;
-					}
-				}
-
-			}
-		}
-
-		if(sel_ind1 != -1) {
-			param_mat->doSwap(sel_ind1, sel_ind2);
-		}
-
-		weight *= 0.99f;
-		if(weight < 0.0001f)
-			weight = 0.5f;
-
-		++it;
-		tabulist[sel_ind1] = it + param_tabulength;
-		tabulist[sel_ind2] = it + param_tabulength;
-
-		if(param_mat->violation() == 0) {
-			int new_ret = param_mat->retention();
-			if(new_ret > best_retention) {
-				for(int i = 0; i < nn; ++i) {
-					best_mat[i] = param_mat->getValue(i);
-				}
-				best_retention = new_ret;
-			}
-			weight = 0.5f;
-		}
-	}
-
-	cout << "Iterations: " << it << endl;
-
-	if(best_retention > -1) {
-		for(int i = 0; i < nn; ++i) {
-			param_mat->setValue(i, best_mat[i]);
-		}
-	}
-
-	delete[] tabulist;
-	delete[] swap_tabulist;
-	delete[] best_mat;
-
-	if(best_retention < 0)
-		return -1;
-	
-	//Return retention;
-	return best_retention;
-
-}
-
-int main(int argc, char **argv) {
-	
-	MSMatrix *mat;
-
-	int n = 0;
-	int mode = 0;
-	int runs = 0;
-	int iterations = 0;
-	int chance_of_random_restart = 1000000;
-	bool terminate_on_first_solution = false;
-
-	//Seed random generator
-	srand(time(0));
-
-	cout << "Dimension: ";
-
-	cin >> n;
-	
-	cout << "Mode (0: Normal, 1: Associative, 2: Semi-Magic): ";
-	
-	cin >> mode;
-
-	if(!(mode == 0 || mode == 1 || mode == 2)) {
-		cout << "Unsupported mode." << endl;
-		return 0;
-	}
-	
-	cout << "Runs: ";
-
-	cin >> runs;
-
-	cout << "Iterations: ";
-
-	cin >> iterations;
-
-	cout << "Chance of random restart (1/x, 0: No Restarts): ";
-
-	cin >> chance_of_random_restart;
-
-	cout << "Terminate on first magic square (Y/N): ";
-	
-	char str[256];
-	
-	cin >> str; 
-	
-	if(str[0] == 'y' || str[0] == 'Y')
-		terminate_on_first_solution = true;
-	
-	int nn = n * n;
-
-	cout << endl;
-
-	mat = new MSMatrix(n, mode == 1, mode == 1 || mode == 2);
-	
-	int best_retention = -1;
-	int *best_mat = new int[nn];
-
-	float time_elapsed = 0.0f;
-	
-	for(int i = 0; i < runs; ++i) {
-
-		mat->randomRestart();
-
-		int clock1 = clock();
-
-		int ret = tabuRetention(mat, (2 * n) / 3, iterations, chance_of_random_restart, terminate_on_first_solution);
-		
-		int clock2 = clock();
-
-		cout << "Run: " << (i + 1) << endl;
-		
-		float t = ((clock2 - clock1)/((float)CLOCKS_PER_SEC));
-		time_elapsed += t;
-		
-		cout << "Time: " << t << "s." << endl;
-
-		if(ret >= 0 && mat->violation() == 0) {
-			cout << "Square satisfies constraints." << endl;
-			cout << "Retention: " << ret << " ( Best: " << best_retention << " )" << endl;
-			if(ret > best_retention) {
-				best_retention = ret;
-				for(int k = 0; k < nn; ++k)
-					best_mat[k] = mat->getValue(k);
-			}
-		} else
-			cout << "TIMEOUT." << endl;
-
-		mat->consolePrint();
-
-	}
-
-	cout << "Best retention found: " << best_retention << endl;
-
-	for(int i = 0; i < n; ++i) {
-		for(int j = 0; j < n; ++j) {
-			cout << best_mat[i * n + j] << "\t";
-		}
-		cout << endl;
-	}
-
-	cout << "Avg Time: " << (time_elapsed / (float)runs) << endl;
-	
-	cout << endl;
-
-	delete mat;
-
-#ifdef WIN32
-	system("pause");
-#endif
-	
-	return 0;
-
-}
\ No newline at end of file
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	water_retention_solver.cpp
+ *	Water Retention Solver running the tabu searches of tabu_search.h
+ *	and the single move searches of local_search.h for jobs read
+ *	interactively, from a batch file or a checkpoint.
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <stdlib.h>
+#include <time.h>
+#include <string.h>
+#include "tabu_search.h"
+#include "local_search.h"
+
+#define MAX(x, y) (x) >= (y) ? (x) : (y)
+
+using namespace std;
+
+/**
+ *	Parameters of a solver job, read by main()
+ */
+
+struct SolverParameters {
+	int n;
+	int mode;
+	int runs;
+	int iterations;
+	int chance_of_random_restart;
+	bool terminate_on_first_solution;
+	int search; //SearchAlgorithm of the runs
+	int history_length; //Of the late acceptance search, 0 for the default
+	int threads; //Threads scanning the neighbourhood of a run
+	int parallel_runs; //Runs executed concurrently
+	unsigned long long seed; //Seed of the random streams of the runs
+	int elite_pool_size; //Island search if above 0
+	int migration_interval;
+	int stagnation_limit;
+	bool conflict_neighbourhood; //Only scan swaps with a conflict cell
+	bool retention_bounds; //Prune swaps by their retention bounds
+	bool delta_cache; //Reuse retention deltas between iterations
+	bool constructive; //Start and restart from constructed magic squares
+	bool magic_moves; //Scan the moves which keep a magic square magic
+	double compound_ratio; //Compound moves per swap of the neighbourhood, 0 for none
+	const char *checkpoint_path; //NULL if the job saves no checkpoints
+	double checkpoint_interval; //Seconds between checkpoints of a run
+	bool resume; //Continue the runs from their checkpoints
+	bool quiet; //Print nothing per run
+	int telemetry_interval; //Iterations between telemetry lines, 0 for none
+	double run_budget; //Seconds of wall time per run, 0 for no limit
+	double job_budget; //Seconds of wall time per job, 0 for no limit
+	AnytimeLog *anytime_log; //NULL unless new best squares are logged
+	bool archive; //Keep an archive of the feasible squares of a run
+	int revisit_limit; //Restart after as many archived squares in a row, 0 never
+};
+
+/**
+ *	The job checkpoint at checkpoint_path holds the parameters which
+ *	determine the results, every run saves its state to
+ *	<checkpoint_path>.run<number>. The threads may differ on resume.
+ */
+
+static bool saveJob(const SolverParameters &param) {
+
+	CheckpointWriter writer(param.checkpoint_path);
+
+	writer.put(param.n);
+	writer.put(param.mode);
+	writer.put(param.runs);
+	writer.put(param.iterations);
+	writer.put(param.chance_of_random_restart);
+	writer.put(param.terminate_on_first_solution);
+	writer.put(param.seed);
+	writer.put(param.conflict_neighbourhood);
+	writer.put(param.retention_bounds);
+	writer.put(param.delta_cache);
+	writer.put(param.constructive);
+	writer.put(param.magic_moves);
+	writer.put(param.compound_ratio);
+	writer.put(param.archive);
+	writer.put(param.revisit_limit);
+
+	return writer.commit();
+
+}
+
+static bool loadJob(const char *param_path, SolverParameters &param) {
+
+	CheckpointReader reader(param_path);
+
+	reader.get(param.n);
+	reader.get(param.mode);
+	reader.get(param.runs);
+	reader.get(param.iterations);
+	reader.get(param.chance_of_random_restart);
+	reader.get(param.terminate_on_first_solution);
+	reader.get(param.seed);
+	reader.get(param.conflict_neighbourhood);
+	reader.get(param.retention_bounds);
+	reader.get(param.delta_cache);
+	reader.get(param.constructive);
+	reader.get(param.magic_moves);
+	reader.get(param.compound_ratio);
+	reader.get(param.archive);
+	reader.get(param.revisit_limit);
+
+	return reader.isValid() && param.n >= 1 && param.n <= MS_MAX_DIMENSION && param.mode >= 0 && param.mode <= 2;
+
+}
+
+/**
+ *	Result of a job
+ */
+
+struct JobResult {
+	int best_retention; //-1 if no run found a square satisfying the constraints
+	int solved_runs;
+	int started_runs; //Fewer than the runs if the job ran out of time
+	double time_elapsed; //Sum of the run times
+	const int *best_mat; //nn values if best_retention >= 0, owned by the workspace
+};
+
+/**
+ *	Matrix, thread pool and buffers of one of the concurrent runs of
+ *	a workspace.
+ */
+
+template<class Matrix>
+struct RunWorker {
+	Matrix *mat;
+	ThreadPool *pool; //Threads scanning the neighbourhood of a run
+	Matrix **thread_mats; //Copy of mat for every thread but the first
+	RetentionBuffers *buffers;
+};
+
+/**
+ *	Shared state of the runs of a job. The threads of the portfolio
+ *	claim runs from next_run, each run draws from its own random
+ *	stream so its result does not depend on the thread executing it.
+ */
+
+template<class Matrix>
+struct Portfolio {
+	const SolverParameters *param;
+	unsigned long long seed;
+
+	RunWorker<Matrix> *workers; //One per thread of the portfolio
+
+	volatile int next_run; //Next run to claim, incremented atomically
+	volatile int solved_runs; //Incremented atomically
+	volatile int started_runs; //Incremented atomically
+
+	double job_deadline; //getWallTime() at which the job stops, 0 for no limit
+
+	//Best retention and the run that found it, packed as
+	//(retention + 1) << 32 | (INT_MAX - run) so that a compare and
+	//swap on a larger key updates both and earlier runs win ties
+	volatile long long best_key;
+
+	const IslandSettings *island; //NULL for independent runs
+
+	int *run_mats; //Square found by each run, nn values per run
+	double time_elapsed; //Sum of the run times, under output_mutex
+
+	Mutex output_mutex;
+};
+
+static long long packBest(int param_retention, int param_run) {
+	return ((long long)(param_retention + 1) << 32) | (long long)(0x7FFFFFFF - param_run);
+}
+
+static int bestRetention(long long param_key) {
+	return (int)(param_key >> 32) - 1;
+}
+
+static int bestRun(long long param_key) {
+	return 0x7FFFFFFF - (int)(param_key & 0xFFFFFFFF);
+}
+
+/**
+ *	Runs claimed runs on the worker of its thread until every run of
+ *	the job is claimed or the job is out of time. The output of a run is buffered and written at
+ *	once when the run is done.
+ */
+
+template<class Matrix>
+void runPortfolioWorker(void *param_arg, int param_thread) {
+
+	Portfolio<Matrix> *portfolio = (Portfolio<Matrix>*)param_arg;
+	const SolverParameters &param = *portfolio->param;
+	RunWorker<Matrix> &worker = portfolio->workers[param_thread];
+
+	int n = param.n;
+	int nn = n * n;
+
+	Matrix *mat = worker.mat;
+
+	while(true) {
+
+		int i = atomicIncrement(&portfolio->next_run) - 1;
+		if(i >= param.runs)
+			break;
+
+		//Runs not started by the deadline are skipped
+		if(portfolio->job_deadline > 0.0 && getWallTime() >= portfolio->job_deadline)
+			break;
+
+		atomicIncrement(&portfolio->started_runs);
+
+		ostringstream out;
+
+		mat->seedRandom(runSeed(portfolio->seed, i));
+		restartSquare(mat, param.constructive);
+
+		CheckpointSettings checkpoint;
+		string checkpoint_path;
+		if(param.checkpoint_path) {
+			ostringstream path;
+			path << param.checkpoint_path << ".run" << (i + 1);
+			checkpoint_path = path.str();
+			checkpoint.path = checkpoint_path.c_str();
+			checkpoint.interval = param.checkpoint_interval;
+			checkpoint.resume = param.resume;
+		}
+
+		TelemetrySettings telemetry;
+		telemetry.interval = param.telemetry_interval;
+		telemetry.run = i + 1;
+		telemetry.out = &cerr;
+
+		double time1 = getWallTime();
+
+		//The run stops at the earlier of its own and the job deadline
+		AnytimeSettings anytime;
+		anytime.deadline = portfolio->job_deadline;
+		if(param.run_budget > 0.0 && (anytime.deadline == 0.0 || time1 + param.run_budget < anytime.deadline))
+			anytime.deadline = time1 + param.run_budget;
+		anytime.log = param.anytime_log;
+		anytime.seed = portfolio->seed;
+		anytime.run = i + 1;
+
+		ArchiveSettings archive;
+		archive.revisit_limit = param.revisit_limit;
+
+		RetentionOptions options;
+		options.conflict_neighbourhood = param.conflict_neighbourhood;
+		options.bounds = param.retention_bounds;
+		options.delta_cache = param.delta_cache;
+		options.constructive_restarts = param.constructive;
+		options.magic_moves = param.magic_moves;
+		options.compound_ratio = param.compound_ratio;
+
+		//The single move searches run on one thread and take no part
+		//in the island search
+		int ret;
+		AcceptanceRule *rule = createAcceptanceRule(param.search, param.history_length);
+		if(rule) {
+			ret = localSearchRetention(mat, rule, param.iterations, param.chance_of_random_restart, param.terminate_on_first_solution, param.constructive, param.compound_ratio, &anytime, worker.buffers, out);
+			delete rule;
+		} else
+			ret = tabuRetention(mat, worker.thread_mats, worker.pool, portfolio->island, (2 * n) / 3, param.iterations, param.chance_of_random_restart, param.terminate_on_first_solution, &options, param.checkpoint_path ? &checkpoint : 0, param.telemetry_interval > 0 ? &telemetry : 0, &anytime, param.archive ? &archive : 0, worker.buffers, out);
+		
+		double time2 = getWallTime();
+
+		out << "Run: " << (i + 1) << endl;
+		
+		float t = (float)(time2 - time1);
+		
+		out << "Time: " << t << "s." << endl;
+
+		if(ret >= 0 && mat->violation() == 0) {
+			out << "Square satisfies constraints." << endl;
+			out << "Retention: " << ret << " ( Best: " << bestRetention(atomicLoad(&portfolio->best_key)) << " )" << endl;
+
+			int *run_mat = portfolio->run_mats + (size_t)i * nn;
+			for(int k = 0; k < nn; ++k)
+				run_mat[k] = mat->getValue(k);
+
+			atomicIncrement(&portfolio->solved_runs);
+
+			long long key = packBest(ret, i);
+			long long best_key = atomicLoad(&portfolio->best_key);
+			while(key > best_key && !atomicCompareExchange(&portfolio->best_key, best_key, key))
+				best_key = atomicLoad(&portfolio->best_key);
+		} else
+			out << "TIMEOUT." << endl;
+
+		mat->consolePrint(out);
+
+		portfolio->output_mutex.lock();
+		portfolio->time_elapsed += t;
+		if(!param.quiet)
+			cout << out.str() << flush;
+		portfolio->output_mutex.unlock();
+
+	}
+
+}
+
+/**
+ *	Matrices, thread pools and buffers of the jobs of one dimension
+ *	and mode. A batch runs its jobs on one workspace until the
+ *	dimension or the mode changes, instead of allocating them per job.
+ */
+
+class SolverWorkspace {
+public:
+	SolverWorkspace(int param_n, int param_mode) : n(param_n), mode(param_mode) {}
+	virtual ~SolverWorkspace() {}
+
+	bool fits(int param_n, int param_mode) { return n == param_n && mode == param_mode; }
+
+	//Runs the job, returns false if its checkpoint could not be written
+	virtual bool run(const SolverParameters &param, JobResult &param_result) = 0;
+
+protected:
+	int n;
+	int mode;
+};
+
+/**
+ *	Runs the independent runs of a job, param_parallel_runs at a time,
+ *	each scanning the neighbourhood with param_threads threads.
+ */
+
+template<class Matrix>
+class MatrixWorkspace : public SolverWorkspace {
+public:
+	MatrixWorkspace(int param_n, int param_mode, int param_threads, int param_parallel_runs);
+	~MatrixWorkspace();
+
+	bool run(const SolverParameters &param, JobResult &param_result);
+
+protected:
+	ThreadPool *run_pool;
+	RunWorker<Matrix> *workers; //One per thread of run_pool
+
+	int *run_mats;
+	size_t run_mats_size;
+};
+
+template<class Matrix>
+MatrixWorkspace<Matrix>::MatrixWorkspace(int param_n, int param_mode, int param_threads, int param_parallel_runs) : SolverWorkspace(param_n, param_mode) {
+
+	run_pool = new ThreadPool(param_parallel_runs);
+	int worker_count = run_pool->getThreadCount();
+	workers = new RunWorker<Matrix>[worker_count];
+
+	for(int w = 0; w < worker_count; ++w) {
+		RunWorker<Matrix> &worker = workers[w];
+
+		worker.mat = new Matrix(n, mode == 1, mode == 1 || mode == 2);
+
+		//Every thread but the first scans on a copy of its own
+		worker.pool = new ThreadPool(param_threads);
+		int thread_mat_count = worker.pool->getThreadCount() - 1;
+		worker.thread_mats = new Matrix*[thread_mat_count + 1];
+		for(int t = 0; t < thread_mat_count; ++t)
+			worker.thread_mats[t] = new Matrix(*worker.mat);
+
+		worker.buffers = new RetentionBuffers(n, worker.pool->getThreadCount());
+	}
+
+	run_mats = 0;
+	run_mats_size = 0;
+
+}
+
+template<class Matrix>
+MatrixWorkspace<Matrix>::~MatrixWorkspace() {
+
+	for(int w = 0; w < run_pool->getThreadCount(); ++w) {
+		RunWorker<Matrix> &worker = workers[w];
+		for(int t = 0; t < worker.pool->getThreadCount() - 1; ++t)
+			delete worker.thread_mats[t];
+		delete[] worker.thread_mats;
+		delete worker.pool;
+		delete worker.mat;
+		delete worker.buffers;
+	}
+
+	delete[] workers;
+	delete run_pool;
+	if(run_mats)
+		delete[] run_mats;
+
+}
+
+template<class Matrix>
+bool MatrixWorkspace<Matrix>::run(const SolverParameters &param, JobResult &param_result) {
+
+	int nn = n * n;
+
+	if(param.checkpoint_path && !saveJob(param)) {
+		cout << "Could not write checkpoint " << param.checkpoint_path << "." << endl;
+		return false;
+	}
+
+	size_t size = (size_t)param.runs * nn;
+	if(size > run_mats_size) {
+		if(run_mats)
+			delete[] run_mats;
+		run_mats = new int[size];
+		run_mats_size = size;
+	}
+
+	Portfolio<Matrix> portfolio;
+	portfolio.param = &param;
+	portfolio.seed = param.seed;
+	portfolio.workers = workers;
+	portfolio.next_run = 0;
+	portfolio.solved_runs = 0;
+	portfolio.started_runs = 0;
+	portfolio.job_deadline = param.job_budget > 0.0 ? getWallTime() + param.job_budget : 0.0;
+	portfolio.best_key = packBest(-1, 0);
+	portfolio.run_mats = run_mats;
+	portfolio.time_elapsed = 0.0;
+	portfolio.island = 0;
+
+	//The runs of an island search share their best squares
+	IslandSettings island;
+	island.elite_pool = 0;
+	if(param.elite_pool_size > 0) {
+		island.elite_pool = new ElitePool(n, param.elite_pool_size);
+		island.migration_interval = param.migration_interval;
+		island.stagnation_limit = param.stagnation_limit;
+		portfolio.island = &island;
+	}
+
+	run_pool->run(runPortfolioWorker<Matrix>, &portfolio);
+
+	param_result.best_retention = bestRetention(portfolio.best_key);
+	param_result.solved_runs = portfolio.solved_runs;
+	param_result.started_runs = portfolio.started_runs;
+	param_result.time_elapsed = portfolio.time_elapsed;
+	param_result.best_mat = 0;
+	if(param_result.best_retention >= 0)
+		param_result.best_mat = run_mats + (size_t)bestRun(portfolio.best_key) * nn;
+
+	if(island.elite_pool)
+		delete island.elite_pool;
+
+	return true;
+
+}
+
+template<class Matrix>
+SolverWorkspace *createWorkspace(int param_n, int param_mode, int param_threads, int param_parallel_runs) {
+	return new MatrixWorkspace<Matrix>(param_n, param_mode, param_threads, param_parallel_runs);
+}
+
+/**
+ *	Dispatch table of the workspaces specialized by dimension and mode,
+ *	other dimensions run on MSMatrix<>.
+ */
+
+typedef SolverWorkspace *(*WorkspaceFactory)(int param_n, int param_mode, int param_threads, int param_parallel_runs);
+
+struct FixedSolver {
+	int n;
+	WorkspaceFactory factories[3]; //Indexed by mode
+};
+
+#define FIXED_SOLVER_ENTRY(DIM) \
+	{ DIM, { createWorkspace<MSMatrix<DIM, MS_MODE_NORMAL> >, \
+		createWorkspace<MSMatrix<DIM, MS_MODE_ASSOCIATIVE> >, \
+		createWorkspace<MSMatrix<DIM, MS_MODE_SEMI_MAGIC> > } },
+
+static const FixedSolver fixed_solvers[] = {
+	MS_FOR_EACH_FIXED_DIMENSION(FIXED_SOLVER_ENTRY)
+};
+
+SolverWorkspace *createSolverWorkspace(int param_n, int param_mode, int param_threads, int param_parallel_runs) {
+
+	int count = sizeof(fixed_solvers) / sizeof(fixed_solvers[0]);
+
+	for(int i = 0; i < count; ++i) {
+		if(fixed_solvers[i].n == param_n)
+			return fixed_solvers[i].factories[param_mode](param_n, param_mode, param_threads, param_parallel_runs);
+	}
+
+	return createWorkspace<MSMatrix<> >(param_n, param_mode, param_threads, param_parallel_runs);
+
+}
+
+/**
+ *	Prints the best square found by a job and the average run time
+ */
+
+static void printJobResult(const SolverParameters &param, const JobResult &param_result) {
+
+	int n = param.n;
+
+	cout << "Best retention found: " << param_result.best_retention << endl;
+
+	if(param_result.best_retention >= 0) {
+		for(int i = 0; i < n; ++i) {
+			for(int j = 0; j < n; ++j) {
+				cout << param_result.best_mat[i * n + j] << "\t";
+			}
+			cout << endl;
+		}
+	}
+
+	if(param_result.started_runs < param.runs)
+		cout << "Runs started before the job time limit: " << param_result.started_runs << " of " << param.runs << endl;
+
+	cout << "Avg Time: " << (param_result.time_elapsed / (float)(param_result.started_runs > 0 ? param_result.started_runs : 1)) << endl;
+	
+	cout << endl;
+
+}
+
+/**
+ *	Batch mode reads one job per line, "n mode runs iterations restart
+ *	[seed [Y/N [search]]]" separated by spaces or commas, where restart
+ *	is the chance of random restart, a missing seed is drawn from
+ *	param_seeds, Y terminates on the first magic square and search is
+ *	tabu, sa or lahc, by default the search of the options. Empty lines
+ *	and lines starting with # are skipped. Returns false for a
+ *	malformed job.
+ */
+
+static bool parseJobLine(const string &param_line, Random &param_seeds, SolverParameters &param) {
+
+	string line = param_line;
+	for(size_t i = 0; i < line.size(); ++i) {
+		if(line[i] == ',')
+			line[i] = ' ';
+	}
+
+	istringstream in(line);
+
+	if(!(in >> param.n >> param.mode >> param.runs >> param.iterations >> param.chance_of_random_restart))
+		return false;
+
+	if(param.n < 1 || param.n > MS_MAX_DIMENSION || param.mode < 0 || param.mode > 2 || param.runs < 1 || param.iterations < 0 || param.chance_of_random_restart < 0)
+		return false;
+
+	param.seed = param_seeds.next64();
+	param.terminate_on_first_solution = false;
+
+	unsigned long long seed;
+	if(in >> seed) {
+		param.seed = seed;
+
+		string terminate;
+		if(in >> terminate)
+			param.terminate_on_first_solution = (terminate[0] == 'y' || terminate[0] == 'Y');
+
+		string search;
+		if(in >> search && (param.search = parseSearchName(search.c_str())) < 0)
+			return false;
+	}
+
+	return true;
+
+}
+
+/**
+ *	Writes the result of a job as one CSV line, or as one JSON object
+ *	per line with param_json.
+ */
+
+static void printJobLine(ostream &param_out, bool param_json, int param_job, const SolverParameters &param, const JobResult &param_result) {
+
+	int nn = param.n * param.n;
+	double avg_time = param_result.time_elapsed / (double)(param_result.started_runs > 0 ? param_result.started_runs : 1);
+
+	if(param_json) {
+		param_out << "{\"job\":" << param_job
+			<< ",\"n\":" << param.n
+			<< ",\"mode\":" << param.mode
+			<< ",\"runs\":" << param.runs
+			<< ",\"iterations\":" << param.iterations
+			<< ",\"restart\":" << param.chance_of_random_restart
+			<< ",\"search\":\"" << searchName(param.search) << "\""
+			<< ",\"seed\":" << param.seed
+			<< ",\"solved\":" << param_result.solved_runs
+			<< ",\"best_retention\":" << param_result.best_retention
+			<< ",\"avg_time\":" << avg_time
+			<< ",\"square\":";
+		if(param_result.best_retention >= 0) {
+			param_out << "[";
+			for(int i = 0; i < nn; ++i)
+				param_out << (i > 0 ? "," : "") << param_result.best_mat[i];
+			param_out << "]";
+		} else
+			param_out << "null";
+		param_out << "}" << endl;
+	} else {
+		param_out << param_job << "," << param.n << "," << param.mode << "," << param.runs << "," << param.iterations << ","
+			<< param.chance_of_random_restart << "," << searchName(param.search) << "," << param.seed << "," << param_result.solved_runs << ","
+			<< param_result.best_retention << "," << avg_time << ",";
+		if(param_result.best_retention >= 0) {
+			for(int i = 0; i < nn; ++i)
+				param_out << (i > 0 ? " " : "") << param_result.best_mat[i];
+		}
+		param_out << endl;
+	}
+
+}
+
+/**
+ *	Runs the jobs read from param_in back to back. Consecutive jobs of
+ *	the same dimension and mode share a workspace. The options of
+ *	param_options apply to every job, the seeds of jobs without one
+ *	are drawn from a stream seeded by param_options.seed.
+ */
+
+static void runBatch(istream &param_in, const SolverParameters &param_options, bool param_json) {
+
+	SolverWorkspace *workspace = 0;
+	Random seeds(param_options.seed);
+
+	if(!param_json)
+		cout << "job,n,mode,runs,iterations,restart,search,seed,solved,best_retention,avg_time,square" << endl;
+
+	string line;
+	int line_number = 0;
+	int job = 0;
+
+	while(getline(param_in, line)) {
+
+		++line_number;
+
+		size_t first = line.find_first_not_of(" \t\r");
+		if(first == string::npos || line[first] == '#')
+			continue;
+
+		SolverParameters param = param_options;
+		if(!parseJobLine(line, seeds, param)) {
+			cerr << "Line " << line_number << ": invalid job." << endl;
+			continue;
+		}
+
+		if(!workspace || !workspace->fits(param.n, param.mode)) {
+			if(workspace)
+				delete workspace;
+			workspace = createSolverWorkspace(param.n, param.mode, param.threads, param.parallel_runs);
+		}
+
+		JobResult result;
+		workspace->run(param, result);
+
+		printJobLine(cout, param_json, ++job, param, result);
+
+	}
+
+	if(workspace)
+		delete workspace;
+
+}
+
+/**
+ *	Opens the anytime log at param_path, returns NULL if it can not be
+ *	opened
+ */
+
+static AnytimeLog *openAnytimeLog(const char *param_path) {
+
+	AnytimeLog *log = new AnytimeLog(param_path);
+
+	if(!log->isOpen()) {
+		cout << "Could not open " << param_path << "." << endl;
+		delete log;
+		return 0;
+	}
+
+	return log;
+
+}
+
+/**
+ *	Seed of a job started without -seed, from the clock
+ */
+
+static unsigned long long timeSeed() {
+
+	unsigned long long x = (unsigned long long)time(0) ^ (unsigned long long)(getWallTime() * 1e9);
+
+	return Random::splitMix64(x);
+
+}
+
+int main(int argc, char **argv) {
+	
+	int n = 0;
+	int mode = 0;
+	int runs = 0;
+	int iterations = 0;
+	int chance_of_random_restart = 1000000;
+	bool terminate_on_first_solution = false;
+	int search = SEARCH_TABU;
+	int history_length = 0;
+	int threads = 1;
+	int parallel_runs = 1;
+	int elite_pool_size = 0;
+	int migration_interval = 100;
+	int stagnation_limit = 1000;
+	bool conflict_neighbourhood = false;
+	bool retention_bounds = false;
+	bool delta_cache = true;
+	bool constructive = false;
+	bool magic_moves = false;
+	double compound_ratio = 0.0;
+	const char *checkpoint_path = 0;
+	double checkpoint_interval = 60.0;
+	const char *resume_path = 0;
+	const char *batch_path = 0;
+	bool json = false;
+	unsigned long long seed = timeSeed();
+	int telemetry_interval = 0;
+	double run_budget = 0.0;
+	double job_budget = 0.0;
+	const char *anytime_path = 0;
+	bool archive = false;
+	int revisit_limit = 0;
+
+	//Options: -threads <count>, -parallel-runs <count>, for both 0 uses
+	//every hardware thread. -elite-pool <size> turns on the island
+	//search, -migration <iterations> and -stagnation <iterations> set
+	//how often runs publish and when they restart from an elite.
+	//-conflicts restricts the scan of an infeasible square to swaps
+	//with a cell in a violated line. -bounds skips the swaps whose
+	//retention bounds show they can not be selected, -no-delta-cache
+	//recomputes every delta in every iteration. -construct starts and restarts the runs
+	//from constructed magic squares instead of random permutations.
+	//-magic-moves also scans the paired swaps and line exchanges which
+	//keep a magic square magic while the square is feasible.
+	//-compound <ratio> mixes 3-cycles and rotations of row and column
+	//segments into the neighbourhood, the tabu search samples ratio
+	//times as many of them as it has swaps every iteration and the
+	//single move searches take one instead of a swap in that share of
+	//their steps.
+	//-checkpoint <path> saves the job and every run to files starting
+	//with path each -checkpoint-interval <seconds>. -resume <path>
+	//continues the job saved at path, with the same results, and takes
+	//every option but the thread counts and the time limits from the
+	//checkpoint.
+	//-batch <file> runs the jobs listed in file, - reads them from
+	//stdin, and prints a CSV line per job, or JSON with -format json.
+	//-seed <value> seeds the random streams of the runs, by default
+	//the seed is taken from the clock.
+	//-telemetry <iterations> writes a line with the counters of the
+	//search to stderr every that many iterations of a run.
+	//-run-time <seconds> and -job-time <seconds> limit the wall time of
+	//every run and of every job, a run out of time keeps the best
+	//square it has found. -anytime <path> appends every new best square
+	//of a run to the CSV file at path as soon as it is found.
+	//-archive keeps the feasible squares of a run up to rotation,
+	//reflection and complement and looks up the retention of squares
+	//seen before, -revisit-limit <count> also restarts a run after
+	//count such squares in a row.
+	//-search <tabu|sa|lahc> runs the tabu search, simulated annealing
+	//or late acceptance hill climbing, batch jobs may choose their own.
+	//An iteration of the single move searches takes a step for every
+	//swap of the neighbourhood of the tabu search. They only use the
+	//-construct, -run-time, -job-time and -anytime options,
+	//-lahc-history <steps> sets the history of the late acceptance
+	//search.
+	for(int i = 1; i < argc; ++i) {
+		if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+			if(threads <= 0)
+				threads = ThreadPool::getHardwareThreads();
+		} else if(strcmp(argv[i], "-parallel-runs") == 0 && i + 1 < argc) {
+			parallel_runs = atoi(argv[++i]);
+			if(parallel_runs <= 0)
+				parallel_runs = ThreadPool::getHardwareThreads();
+		} else if(strcmp(argv[i], "-elite-pool") == 0 && i + 1 < argc) {
+			elite_pool_size = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "-migration") == 0 && i + 1 < argc) {
+			migration_interval = atoi(argv[++i]);
+			if(migration_interval < 1)
+				migration_interval = 1;
+		} else if(strcmp(argv[i], "-stagnation") == 0 && i + 1 < argc) {
+			stagnation_limit = atoi(argv[++i]);
+			if(stagnation_limit < 1)
+				stagnation_limit = 1;
+		} else if(strcmp(argv[i], "-conflicts") == 0) {
+			conflict_neighbourhood = true;
+		} else if(strcmp(argv[i], "-bounds") == 0) {
+			retention_bounds = true;
+		} else if(strcmp(argv[i], "-no-delta-cache") == 0) {
+			delta_cache = false;
+		} else if(strcmp(argv[i], "-construct") == 0) {
+			constructive = true;
+		} else if(strcmp(argv[i], "-magic-moves") == 0) {
+			magic_moves = true;
+		} else if(strcmp(argv[i], "-compound") == 0 && i + 1 < argc) {
+			compound_ratio = atof(argv[++i]);
+			if(compound_ratio < 0.0 || compound_ratio > 1.0) {
+				cout << "The compound move ratio has to be in [0, 1]." << endl;
+				return 0;
+			}
+		} else if(strcmp(argv[i], "-checkpoint") == 0 && i + 1 < argc) {
+			checkpoint_path = argv[++i];
+		} else if(strcmp(argv[i], "-checkpoint-interval") == 0 && i + 1 < argc) {
+			checkpoint_interval = atof(argv[++i]);
+		} else if(strcmp(argv[i], "-resume") == 0 && i + 1 < argc) {
+			resume_path = argv[++i];
+		} else if(strcmp(argv[i], "-batch") == 0 && i + 1 < argc) {
+			batch_path = argv[++i];
+		} else if(strcmp(argv[i], "-format") == 0 && i + 1 < argc) {
+			json = (strcmp(argv[++i], "json") == 0);
+		} else if(strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+			istringstream in(argv[++i]);
+			in >> seed;
+		} else if(strcmp(argv[i], "-telemetry") == 0 && i + 1 < argc) {
+			telemetry_interval = atoi(argv[++i]);
+			if(telemetry_interval < 0)
+				telemetry_interval = 0;
+		} else if(strcmp(argv[i], "-run-time") == 0 && i + 1 < argc) {
+			run_budget = atof(argv[++i]);
+		} else if(strcmp(argv[i], "-job-time") == 0 && i + 1 < argc) {
+			job_budget = atof(argv[++i]);
+		} else if(strcmp(argv[i], "-anytime") == 0 && i + 1 < argc) {
+			anytime_path = argv[++i];
+		} else if(strcmp(argv[i], "-search") == 0 && i + 1 < argc) {
+			search = parseSearchName(argv[++i]);
+			if(search < 0) {
+				cout << "Unknown search " << argv[i] << "." << endl;
+				return 0;
+			}
+		} else if(strcmp(argv[i], "-lahc-history") == 0 && i + 1 < argc) {
+			history_length = atoi(argv[++i]);
+			if(history_length < 0)
+				history_length = 0;
+		} else if(strcmp(argv[i], "-archive") == 0) {
+			archive = true;
+		} else if(strcmp(argv[i], "-revisit-limit") == 0 && i + 1 < argc) {
+			archive = true;
+			revisit_limit = atoi(argv[++i]);
+			if(revisit_limit < 0)
+				revisit_limit = 0;
+		}
+	}
+
+	//The runs of an island search depend on each other through the
+	//elite pool and can not be continued one by one
+	if(checkpoint_path && elite_pool_size > 0) {
+		cout << "Checkpoints are not supported by the island search." << endl;
+		return 0;
+	}
+
+	if((checkpoint_path || resume_path) && search != SEARCH_TABU) {
+		cout << "Checkpoints are only supported by the tabu search." << endl;
+		return 0;
+	}
+
+	//Options of every job
+	SolverParameters param;
+	param.threads = threads;
+	param.parallel_runs = parallel_runs;
+	param.seed = seed;
+	param.search = search;
+	param.history_length = history_length;
+	param.elite_pool_size = elite_pool_size;
+	param.migration_interval = migration_interval;
+	param.stagnation_limit = stagnation_limit;
+	param.conflict_neighbourhood = conflict_neighbourhood;
+	param.retention_bounds = retention_bounds;
+	param.delta_cache = delta_cache;
+	param.constructive = constructive;
+	param.magic_moves = magic_moves;
+	param.compound_ratio = compound_ratio;
+	param.checkpoint_path = checkpoint_path;
+	param.checkpoint_interval = checkpoint_interval;
+	param.resume = false;
+	param.quiet = false;
+	param.telemetry_interval = telemetry_interval;
+	param.run_budget = run_budget;
+	param.job_budget = job_budget;
+	param.anytime_log = 0;
+	param.archive = archive;
+	param.revisit_limit = revisit_limit;
+
+	if(batch_path) {
+
+		if(checkpoint_path || resume_path) {
+			cout << "Checkpoints are not supported in batch mode." << endl;
+			return 0;
+		}
+
+		param.quiet = true;
+
+		if(anytime_path && !(param.anytime_log = openAnytimeLog(anytime_path)))
+			return 0;
+
+		if(strcmp(batch_path, "-") == 0) {
+			runBatch(cin, param, json);
+		} else {
+			ifstream in(batch_path);
+			if(in)
+				runBatch(in, param, json);
+			else
+				cout << "Could not open " << batch_path << "." << endl;
+		}
+
+		if(param.anytime_log)
+			delete param.anytime_log;
+
+		return 0;
+
+	}
+
+	if(resume_path) {
+
+		if(!loadJob(resume_path, param)) {
+			cout << "Could not read checkpoint " << resume_path << "." << endl;
+			return 0;
+		}
+
+		param.elite_pool_size = 0;
+		param.checkpoint_path = resume_path;
+		param.resume = true;
+
+	} else {
+
+		cout << "Dimension: ";
+
+		cin >> n;
+		
+		cout << "Mode (0: Normal, 1: Associative, 2: Semi-Magic): ";
+		
+		cin >> mode;
+
+		if(n < 1 || n > MS_MAX_DIMENSION) {
+			cout << "Unsupported dimension." << endl;
+			return 0;
+		}
+
+		if(!(mode == 0 || mode == 1 || mode == 2)) {
+			cout << "Unsupported mode." << endl;
+			return 0;
+		}
+		
+		cout << "Runs: ";
+
+		cin >> runs;
+
+		cout << "Iterations: ";
+
+		cin >> iterations;
+
+		cout << "Chance of random restart (1/x, 0: No Restarts): ";
+
+		cin >> chance_of_random_restart;
+
+		cout << "Terminate on first magic square (Y/N): ";
+		
+		char str[256];
+		
+		cin >> str; 
+		
+		if(str[0] == 'y' || str[0] == 'Y')
+			terminate_on_first_solution = true;
+		
+		cout << endl;
+
+		param.n = n;
+		param.mode = mode;
+		param.runs = runs;
+		param.iterations = iterations;
+		param.chance_of_random_restart = chance_of_random_restart;
+		param.terminate_on_first_solution = terminate_on_first_solution;
+
+	}
+
+	if(anytime_path && !(param.anytime_log = openAnytimeLog(anytime_path)))
+		return 0;
+
+	//The seed and the run number regenerate any square found
+	cout << "Seed: " << param.seed << endl << endl;
+
+	int run_threads = param.parallel_runs < param.runs ? param.parallel_runs : param.runs;
+
+	SolverWorkspace *workspace = createSolverWorkspace(param.n, param.mode, param.threads, run_threads);
+
+	JobResult result;
+	if(workspace->run(param, result))
+		printJobResult(param, result);
+
+	delete workspace;
+
+	if(param.anytime_log)
+		delete param.anytime_log;
+
+#ifdef WIN32
+	system("pause");
+#endif
+	
+	return 0;
+
+}
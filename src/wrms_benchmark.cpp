@@ -0,0 +1,483 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	wrms_benchmark.cpp
+ *	Benchmarks of the solver kernels and of whole tabuRetention
+ *	iterations. Every benchmark runs a fixed amount of work from a
+ *	fixed seed and reports its time and a checksum of its results as
+ *	one line of JSON, so the output of two builds can be diffed.
+ *
+ *	Usage: wrms_benchmark [-dim <n>]... [-repeats <count>]
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include "tabu_search.h"
+#include "local_search.h"
+#include "minpriorityqueue.h"
+
+using namespace std;
+
+#define BENCHMARK_SEED 20120701u
+
+//Operations per benchmark, divided by the cells or the swaps of the
+//dimension so every benchmark takes a similar time at every dimension
+#define BENCHMARK_CELL_WORK 4000000
+#define BENCHMARK_SWAP_OPS 200000
+#define BENCHMARK_ITERATION_WORK 2000000
+#define BENCHMARK_STEP_WORK 500000
+
+//Swaps between two rebuilds of the merge tree in the delta benchmarks
+#define BENCHMARK_SQUARE_SWAPS 1000
+
+/**
+ *	Writes the results as a JSON object with one benchmark per line.
+ *	The time of a benchmark is the fastest of its repeats.
+ */
+
+class BenchmarkReport {
+public:
+	BenchmarkReport(ostream &param_out, int param_repeats) : out(param_out), repeats(param_repeats), count(0) {
+		out << "{\"seed\":" << BENCHMARK_SEED << ",\"repeats\":" << repeats << ",\"benchmarks\":[" << endl;
+	}
+
+	~BenchmarkReport() {
+		out << endl << "]}" << endl;
+	}
+
+	int getRepeats() { return repeats; }
+
+	void add(const char *param_kernel, int param_n, long long param_ops, long long param_checksum, double param_seconds) {
+		if(count++ > 0)
+			out << "," << endl;
+		out << "{\"kernel\":\"" << param_kernel << "\",\"n\":" << param_n
+			<< ",\"ops\":" << param_ops
+			<< ",\"checksum\":" << param_checksum
+			<< ",\"seconds\":" << param_seconds
+			<< ",\"ns_per_op\":" << (param_ops > 0 ? param_seconds * 1e9 / (double)param_ops : 0.0)
+			<< ",\"ops_per_second\":" << (param_seconds > 0.0 ? (double)param_ops / param_seconds : 0.0)
+			<< "}";
+	}
+
+protected:
+	ostream &out;
+	int repeats;
+	int count;
+};
+
+/**
+ *	Random distinct cell pairs drawn from a fixed seed
+ */
+
+static void makePairs(int param_nn, int param_count, vector<int> &param_index1, vector<int> &param_index2) {
+
+	Random random(BENCHMARK_SEED);
+
+	param_index1.resize(param_count);
+	param_index2.resize(param_count);
+
+	for(int k = 0; k < param_count; ++k) {
+		int i1 = random.nextInt(param_nn);
+		int i2 = random.nextInt(param_nn - 1);
+		if(i2 >= i1)
+			++i2;
+		param_index1[k] = i1;
+		param_index2[k] = i2;
+	}
+
+}
+
+/**
+ *	Water retention of a height map by a priority flood from the
+ *	border on the given queue, the same flood as MSMatrix::retention()
+ *	without the padding and the specializations.
+ */
+
+template<class Queue>
+int floodRetention(const int *param_heights, int param_n, Queue &param_queue, char *param_visited) {
+
+	int nn = param_n * param_n;
+
+	for(int i = 0; i < nn; ++i)
+		param_visited[i] = 0;
+
+	for(int i = 0; i < nn; ++i) {
+		int r = i / param_n;
+		int c = i % param_n;
+		if(r == 0 || c == 0 || r == param_n - 1 || c == param_n - 1) {
+			param_visited[i] = 1;
+			param_queue.enqueue(i, param_heights[i]);
+		}
+	}
+
+	int retention = 0;
+	int index;
+	int level;
+
+	while(param_queue.dequeue(&index, &level)) {
+		int r = index / param_n;
+		int c = index % param_n;
+		int neighbours[4] = { r > 0 ? index - param_n : -1, r < param_n - 1 ? index + param_n : -1,
+			c > 0 ? index - 1 : -1, c < param_n - 1 ? index + 1 : -1 };
+
+		for(int k = 0; k < 4; ++k) {
+			int nb = neighbours[k];
+			if(nb < 0 || param_visited[nb])
+				continue;
+			param_visited[nb] = 1;
+			int nb_level = param_heights[nb] > level ? param_heights[nb] : level;
+			retention += nb_level - param_heights[nb];
+			param_queue.enqueue(nb, nb_level);
+		}
+	}
+
+	return retention;
+
+}
+
+template<class Queue>
+void benchmarkQueue(BenchmarkReport &param_report, const char *param_kernel, int param_n, const vector<int> &param_squares, int param_square_count) {
+
+	int nn = param_n * param_n;
+	int ops = BENCHMARK_CELL_WORK / nn;
+
+	Queue queue(nn, nn);
+	char *visited = new char[nn];
+
+	double best_time = 0.0;
+	long long checksum = 0;
+
+	for(int r = 0; r < param_report.getRepeats(); ++r) {
+		checksum = 0;
+		double time1 = getWallTime();
+		for(int k = 0; k < ops; ++k)
+			checksum += floodRetention(&param_squares[(size_t)(k % param_square_count) * nn], param_n, queue, visited);
+		double time = getWallTime() - time1;
+		if(r == 0 || time < best_time)
+			best_time = time;
+	}
+
+	param_report.add(param_kernel, param_n, ops, checksum, best_time);
+
+	delete[] visited;
+
+}
+
+/**
+ *	Runs the kernel benchmarks of one dimension on the matrix type the
+ *	solver uses for it.
+ */
+
+template<class Matrix>
+void benchmarkMatrix(BenchmarkReport &param_report, int param_n) {
+
+	int n = param_n;
+	int nn = n * n;
+	int repeats = param_report.getRepeats();
+
+	Matrix mat(n, false, false);
+
+	//Squares for the whole-square kernels, random permutations
+	int square_count = 64;
+	vector<int> squares((size_t)square_count * nn);
+	mat.seedRandom(BENCHMARK_SEED);
+	for(int s = 0; s < square_count; ++s) {
+		mat.randomRestart();
+		for(int i = 0; i < nn; ++i)
+			squares[(size_t)s * nn + i] = mat.getValue(i);
+	}
+
+	vector<int> index1;
+	vector<int> index2;
+	makePairs(nn, BENCHMARK_SWAP_OPS, index1, index2);
+
+	int cell_ops = BENCHMARK_CELL_WORK / nn;
+	if(cell_ops > BENCHMARK_SWAP_OPS)
+		cell_ops = BENCHMARK_SWAP_OPS;
+
+	//Whole-square kernels, one swap between two evaluations so every
+	//evaluation sees another square
+
+	const char *square_kernels[3] = { "retention", "retention_merge_tree", "violation" };
+
+	for(int kernel = 0; kernel < 3; ++kernel) {
+		double best_time = 0.0;
+		long long checksum = 0;
+
+		for(int r = 0; r < repeats; ++r) {
+			for(int i = 0; i < nn; ++i)
+				mat.setValue(i, squares[i]);
+			mat.violation();
+
+			checksum = 0;
+			double time1 = getWallTime();
+			for(int k = 0; k < cell_ops; ++k) {
+				mat.doSwap(index1[k], index2[k]);
+				if(kernel == 0)
+					checksum += mat.retention();
+				else if(kernel == 1)
+					checksum += mat.retentionMergeTree();
+				else
+					checksum += mat.violation();
+			}
+			double time = getWallTime() - time1;
+			if(r == 0 || time < best_time)
+				best_time = time;
+		}
+
+		param_report.add(square_kernels[kernel], n, cell_ops, checksum, best_time);
+	}
+
+	//Swap kernels, evaluated on a square which changes every
+	//BENCHMARK_SQUARE_SWAPS swaps
+
+	const char *swap_kernels[2] = { "swap_retention_delta", "swap_delta" };
+
+	for(int kernel = 0; kernel < 2; ++kernel) {
+		double best_time = 0.0;
+		long long checksum = 0;
+
+		for(int r = 0; r < repeats; ++r) {
+			for(int i = 0; i < nn; ++i)
+				mat.setValue(i, squares[i]);
+			mat.violation();
+
+			checksum = 0;
+			double time1 = getWallTime();
+			for(int k = 0; k < BENCHMARK_SWAP_OPS; ++k) {
+				if(k % BENCHMARK_SQUARE_SWAPS == 0) {
+					int s = k / BENCHMARK_SQUARE_SWAPS;
+					mat.doSwap(index2[s], index1[s]);
+					if(kernel == 0)
+						mat.retentionMergeTree();
+				}
+				if(kernel == 0)
+					checksum += mat.swapRetentionDelta(index1[k], index2[k]);
+				else
+					checksum += mat.swapDelta(index1[k], index2[k]);
+			}
+			double time = getWallTime() - time1;
+			if(r == 0 || time < best_time)
+				best_time = time;
+		}
+
+		param_report.add(swap_kernels[kernel], n, BENCHMARK_SWAP_OPS, checksum, best_time);
+	}
+
+	//Violation deltas of compound moves one by one and in batches of
+	//COMPOUND_BATCH_SIZE, which read the sums once per batch
+
+	vector<int> cycle_cells;
+	vector<int> cycle_starts(1, 0);
+	vector<int> cycle(n > 3 ? n : 3);
+	mat.seedRandom(BENCHMARK_SEED);
+	for(int k = 0; k < BENCHMARK_SWAP_OPS; ++k) {
+		int count = randomCompoundMove(&mat, (const int*)0, 0, &cycle[0]);
+		cycle_cells.insert(cycle_cells.end(), cycle.begin(), cycle.begin() + count);
+		cycle_starts.push_back((int)cycle_cells.size());
+	}
+	vector<int> cycle_deltas(COMPOUND_BATCH_SIZE);
+
+	const char *cycle_kernels[2] = { "cycle_delta", "cycle_deltas_batched" };
+
+	for(int kernel = 0; kernel < 2; ++kernel) {
+		double best_time = 0.0;
+		long long checksum = 0;
+
+		for(int r = 0; r < repeats; ++r) {
+			for(int i = 0; i < nn; ++i)
+				mat.setValue(i, squares[i]);
+			mat.violation();
+
+			checksum = 0;
+			double time1 = getWallTime();
+			for(int k = 0; k < BENCHMARK_SWAP_OPS; k += COMPOUND_BATCH_SIZE) {
+				if(k % BENCHMARK_SQUARE_SWAPS < COMPOUND_BATCH_SIZE) {
+					int s = k / BENCHMARK_SQUARE_SWAPS;
+					mat.doSwap(index2[s], index1[s]);
+				}
+				int moves = BENCHMARK_SWAP_OPS - k < COMPOUND_BATCH_SIZE ? BENCHMARK_SWAP_OPS - k : COMPOUND_BATCH_SIZE;
+				if(kernel == 0) {
+					for(int m = k; m < k + moves; ++m)
+						checksum += mat.cycleDelta(&cycle_cells[cycle_starts[m]], cycle_starts[m + 1] - cycle_starts[m]);
+				} else {
+					mat.cycleDeltas(&cycle_cells[0], &cycle_starts[k], moves, &cycle_deltas[0]);
+					for(int m = 0; m < moves; ++m)
+						checksum += cycle_deltas[m];
+				}
+			}
+			double time = getWallTime() - time1;
+			if(r == 0 || time < best_time)
+				best_time = time;
+		}
+
+		param_report.add(cycle_kernels[kernel], n, BENCHMARK_SWAP_OPS, checksum, best_time);
+	}
+
+	//The queues of minpriorityqueue.h on the water retention flood
+
+	benchmarkQueue<BucketQueue>(param_report, "queue_bucket", n, squares, square_count);
+	benchmarkQueue<MinHeapQueue>(param_report, "queue_minheap", n, squares, square_count);
+	benchmarkQueue<SortedArrayQueue>(param_report, "queue_sorted_array", n, squares, square_count);
+
+	//Whole iterations of the retention search on one thread, with the
+	//default options of the solver, with the retention bounds and
+	//without the delta cache. Neither changes the search, so all three
+	//give the same checksum.
+
+	int iterations = BENCHMARK_ITERATION_WORK / (nn * nn);
+	if(iterations < 5)
+		iterations = 5;
+
+	ThreadPool pool(1);
+	RetentionBuffers buffers(n, pool.getThreadCount());
+
+	RetentionOptions options;
+	options.conflict_neighbourhood = false;
+	options.bounds = false;
+	options.delta_cache = true;
+	options.constructive_restarts = false;
+	options.magic_moves = false;
+	options.compound_ratio = 0.0;
+
+	const char *tabu_kernels[3] = { "tabu_retention_iteration", "tabu_retention_iteration_bounds", "tabu_retention_iteration_no_delta_cache" };
+	bool tabu_bounds[3] = { false, true, false };
+	bool tabu_delta_cache[3] = { true, true, false };
+
+	double best_time = 0.0;
+	long long checksum = 0;
+
+	for(int kernel = 0; kernel < 3; ++kernel) {
+		options.bounds = tabu_bounds[kernel];
+		options.delta_cache = tabu_delta_cache[kernel];
+
+		best_time = 0.0;
+		checksum = 0;
+
+		for(int r = 0; r < repeats; ++r) {
+			ostringstream out;
+
+			mat.seedRandom(BENCHMARK_SEED);
+			mat.randomRestart();
+
+			double time1 = getWallTime();
+			int ret = tabuRetention(&mat, (Matrix**)0, &pool, (const IslandSettings*)0, (2 * n) / 3, iterations, 0, false, &options, (const CheckpointSettings*)0, (const TelemetrySettings*)0, (const AnytimeSettings*)0, (const ArchiveSettings*)0, &buffers, out);
+			double time = getWallTime() - time1;
+
+			checksum = ret;
+			for(int i = 0; i < nn; ++i)
+				checksum = checksum * 31 + mat.getValue(i);
+
+			if(r == 0 || time < best_time)
+				best_time = time;
+		}
+
+		param_report.add(tabu_kernels[kernel], n, iterations, checksum, best_time);
+	}
+
+	//Whole iterations of the single move searches, a step for every
+	//swap of the neighbourhood
+
+	int search_iterations = BENCHMARK_STEP_WORK / (nn * (nn - 1) / 2);
+	if(search_iterations < 1)
+		search_iterations = 1;
+
+	const char *search_kernels[2] = { "annealing_iteration", "late_acceptance_iteration" };
+	int searches[2] = { SEARCH_ANNEALING, SEARCH_LATE_ACCEPTANCE };
+
+	for(int kernel = 0; kernel < 2; ++kernel) {
+		best_time = 0.0;
+		checksum = 0;
+
+		for(int r = 0; r < repeats; ++r) {
+			ostringstream out;
+
+			mat.seedRandom(BENCHMARK_SEED);
+			mat.randomRestart();
+
+			AcceptanceRule *rule = createAcceptanceRule(searches[kernel], 0);
+
+			double time1 = getWallTime();
+			int ret = localSearchRetention(&mat, rule, search_iterations, 0, false, false, 0.0, (const AnytimeSettings*)0, &buffers, out);
+			double time = getWallTime() - time1;
+
+			delete rule;
+
+			checksum = ret;
+			for(int i = 0; i < nn; ++i)
+				checksum = checksum * 31 + mat.getValue(i);
+
+			if(r == 0 || time < best_time)
+				best_time = time;
+		}
+
+		param_report.add(search_kernels[kernel], n, search_iterations, checksum, best_time);
+	}
+
+}
+
+/**
+ *	The fixed specializations of the solver dispatch, other dimensions
+ *	run on MSMatrix<>.
+ */
+
+static void benchmarkDimension(BenchmarkReport &param_report, int param_n) {
+
+	switch(param_n) {
+#define BENCHMARK_FIXED_DIMENSION(DIM) \
+	case DIM: benchmarkMatrix<MSMatrix<DIM, MS_MODE_NORMAL> >(param_report, param_n); return;
+	MS_FOR_EACH_FIXED_DIMENSION(BENCHMARK_FIXED_DIMENSION)
+#undef BENCHMARK_FIXED_DIMENSION
+	default:
+		benchmarkMatrix<MSMatrix<> >(param_report, param_n);
+	}
+
+}
+
+int main(int argc, char **argv) {
+
+	vector<int> dimensions;
+	int repeats = 3;
+
+	for(int i = 1; i < argc; ++i) {
+		if(strcmp(argv[i], "-dim") == 0 && i + 1 < argc) {
+			int n = atoi(argv[++i]);
+			if(n >= 3 && n <= MS_MAX_DIMENSION)
+				dimensions.push_back(n);
+		} else if(strcmp(argv[i], "-repeats") == 0 && i + 1 < argc) {
+			repeats = atoi(argv[++i]);
+			if(repeats < 1)
+				repeats = 1;
+		}
+	}
+
+	if(dimensions.empty()) {
+		dimensions.push_back(6);
+		dimensions.push_back(10);
+		dimensions.push_back(16);
+		dimensions.push_back(24);
+	}
+
+	BenchmarkReport report(cout, repeats);
+
+	for(size_t d = 0; d < dimensions.size(); ++d)
+		benchmarkDimension(report, dimensions[d]);
+
+	return 0;
+
+}
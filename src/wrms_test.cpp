@@ -0,0 +1,310 @@
+
+/**
+ *	Water Retention on Magic Squares Solver
+ *
+ *	Author: Johan Öfverstedt
+ *	Modified: July 2012
+ *	Version 0.13a
+ *
+ *	wrms_test.cpp
+ *	Checks of the incremental kernels and of the searches. Every
+ *	incremental violation, retention delta, move and rollback equals a
+ *	full recompute, and a run started from a constructed magic square,
+ *	with constructive restarts, never reports a best square holding
+ *	less water than the square it started from. Prints a line per
+ *	failed check and returns 1 if any check failed.
+ *
+ *	Project website:
+ *	sourceforge.net/projects/wrmssolver
+ *
+ *	Based on thesis:
+ *	http://urn.kb.se/resolve?urn=urn:nbn:se:uu:diva-176018
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include "tabu_search.h"
+#include "local_search.h"
+#include "compound_moves.h"
+
+using namespace std;
+
+#define TEST_SEED 20120701u
+
+//Iterations of every run, with a restart every few iterations so the
+//restarts are scored as well
+#define TEST_ITERATIONS 40
+#define TEST_RESTART_CHANCE 5
+
+//Random squares of every dimension and mode and random moves on each
+//in the checks of the incremental kernels
+#define TEST_SQUARES 6
+#define TEST_MOVES 150
+
+static int reportMismatch(const char *param_check, int param_n, int param_mode, int param_square, int param_move, int param_incremental, int param_full) {
+
+	cout << "FAILED " << param_check << ": n=" << param_n << " mode=" << param_mode << " square=" << param_square
+		<< " move=" << param_move << " incremental=" << param_incremental << " full=" << param_full << endl;
+
+	return 1;
+
+}
+
+/**
+ *	Makes seeded random moves on random squares of dimension param_n
+ *	in param_mode and compares every incremental result with a full
+ *	recompute on a copy. Half of the squares start from retention(),
+ *	so swapRetentionDelta() re-floods, the other half from
+ *	retentionMergeTree(), so it is answered by the merge tree until
+ *	the first committed move. Every move checks:
+ *	- swapDelta(), cycleDelta() and the stored violation of doSwap()
+ *	- and doCycle() against violation(),
+ *	- swapRetentionDelta() against retention(), and that it leaves the
+ *	- values and the water levels as they were,
+ *	- a move of one to three swaps or a compound move made with
+ *	- applySwap() and applyCycle(), its violation, retention and water
+ *	- levels against violation() and retention(), and after
+ *	- rollbackMove() the values, levels, violation and retention from
+ *	- before the move, or after commitMove() its stored retention.
+ *	Returns the number of failed checks.
+ */
+
+template<class Matrix>
+static int testIncremental(int param_n, int param_mode) {
+
+	int failed = 0;
+	int nn = param_n * param_n;
+
+	bool associative = param_mode == MS_MODE_ASSOCIATIVE;
+	bool semi_magic = param_mode != MS_MODE_NORMAL;
+
+	Matrix mat(param_n, associative, semi_magic);
+	Matrix full(param_n, associative, semi_magic);
+
+	mat.seedRandom(TEST_SEED + param_n * 3 + param_mode);
+	Random &random = mat.getRandom();
+
+	int *values = new int[nn];
+	int *levels = new int[nn];
+	int cells[MS_MAX_DIMENSION];
+
+	for(int square = 0; square < TEST_SQUARES; ++square) {
+		mat.randomRestart();
+
+		int retention;
+		if(square % 2 == 0)
+			retention = mat.retention();
+		else
+			retention = mat.retentionMergeTree();
+
+		for(int move = 0; move < TEST_MOVES; ++move) {
+			int violation = mat.getStoredViolation();
+
+			for(int i = 0; i < nn; ++i) {
+				values[i] = mat.getValue(i);
+				levels[i] = mat.getWaterLevel(i);
+			}
+
+			int i1 = random.nextInt(nn);
+			int i2 = random.nextInt(nn - 1);
+			if(i2 >= i1)
+				++i2;
+
+			//A single swap and a compound move made on the copy
+
+			int delta = mat.swapDelta(i1, i2);
+			int retention_delta = mat.swapRetentionDelta(i1, i2);
+
+			full.copyState(mat);
+			full.doSwap(i1, i2);
+			int stored = full.getStoredViolation();
+			if(stored != full.violation())
+				failed += reportMismatch("doSwap violation", param_n, param_mode, square, move, stored, full.violation());
+			if(violation + delta != full.violation())
+				failed += reportMismatch("swapDelta", param_n, param_mode, square, move, violation + delta, full.violation());
+			if(retention + retention_delta != full.retention())
+				failed += reportMismatch("swapRetentionDelta", param_n, param_mode, square, move, retention + retention_delta, full.retention());
+
+			for(int i = 0; i < nn; ++i) {
+				if(mat.getValue(i) != values[i] || mat.getWaterLevel(i) != levels[i]) {
+					failed += reportMismatch("swapRetentionDelta restore", param_n, param_mode, square, move, mat.getWaterLevel(i), levels[i]);
+					break;
+				}
+			}
+
+			int count = randomCompoundMove(&mat, (const int*)0, 0, cells);
+			int cycle_delta = mat.cycleDelta(cells, count);
+
+			full.copyState(mat);
+			full.doCycle(cells, count);
+			stored = full.getStoredViolation();
+			if(stored != full.violation())
+				failed += reportMismatch("doCycle violation", param_n, param_mode, square, move, stored, full.violation());
+			if(violation + cycle_delta != full.violation())
+				failed += reportMismatch("cycleDelta", param_n, param_mode, square, move, violation + cycle_delta, full.violation());
+
+			//A tentative move, rolled back two times in three
+
+			mat.beginMove();
+			if(random.nextInt(4) == 0) {
+				count = randomCompoundMove(&mat, (const int*)0, 0, cells);
+				mat.applyCycle(cells, count);
+			} else {
+				int swaps = 1 + random.nextInt(3);
+				for(int k = 0; k < swaps; ++k) {
+					i1 = random.nextInt(nn);
+					i2 = random.nextInt(nn - 1);
+					if(i2 >= i1)
+						++i2;
+					mat.applySwap(i1, i2);
+				}
+			}
+
+			full.copyState(mat);
+			int full_violation = full.violation();
+			int full_retention = full.retention();
+
+			if(mat.getStoredViolation() != full_violation)
+				failed += reportMismatch("move violation", param_n, param_mode, square, move, mat.getStoredViolation(), full_violation);
+			if(mat.getMoveRetention() != full_retention)
+				failed += reportMismatch("move retention", param_n, param_mode, square, move, mat.getMoveRetention(), full_retention);
+
+			for(int i = 0; i < nn; ++i) {
+				if(mat.getWaterLevel(i) != full.getWaterLevel(i)) {
+					failed += reportMismatch("move water level", param_n, param_mode, square, move, mat.getWaterLevel(i), full.getWaterLevel(i));
+					break;
+				}
+			}
+
+			if(random.nextInt(3) == 0) {
+				mat.commitMove();
+				retention = mat.getLastRetention();
+				if(retention != full_retention)
+					failed += reportMismatch("commitMove retention", param_n, param_mode, square, move, retention, full_retention);
+			} else {
+				mat.rollbackMove();
+				if(mat.getStoredViolation() != violation)
+					failed += reportMismatch("rollbackMove violation", param_n, param_mode, square, move, mat.getStoredViolation(), violation);
+				if(mat.getLastRetention() != retention)
+					failed += reportMismatch("rollbackMove retention", param_n, param_mode, square, move, mat.getLastRetention(), retention);
+
+				for(int i = 0; i < nn; ++i) {
+					if(mat.getValue(i) != values[i] || mat.getWaterLevel(i) != levels[i]) {
+						failed += reportMismatch("rollbackMove restore", param_n, param_mode, square, move, mat.getWaterLevel(i), levels[i]);
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	delete[] values;
+	delete[] levels;
+
+	return failed;
+
+}
+
+/**
+ *	Checks the incremental kernels of MSMatrix<> and of the fixed
+ *	specialization of the dimension and mode if there is one
+ */
+
+static int testIncrementalDimension(int param_n, int param_mode) {
+
+	int failed = testIncremental<MSMatrix<> >(param_n, param_mode);
+
+	switch(param_n) {
+#define TEST_FIXED_DIMENSION(DIM) \
+	case DIM: \
+		if(param_mode == MS_MODE_NORMAL) \
+			failed += testIncremental<MSMatrix<DIM, MS_MODE_NORMAL> >(param_n, param_mode); \
+		else if(param_mode == MS_MODE_ASSOCIATIVE) \
+			failed += testIncremental<MSMatrix<DIM, MS_MODE_ASSOCIATIVE> >(param_n, param_mode); \
+		else \
+			failed += testIncremental<MSMatrix<DIM, MS_MODE_SEMI_MAGIC> >(param_n, param_mode); \
+		break;
+	MS_FOR_EACH_FIXED_DIMENSION(TEST_FIXED_DIMENSION)
+#undef TEST_FIXED_DIMENSION
+	default:
+		break;
+	}
+
+	return failed;
+
+}
+
+/**
+ *	Runs every search from a constructed square of dimension param_n in
+ *	param_mode and checks the best square against it. Returns the
+ *	number of failed checks.
+ */
+
+static int testConstructiveStart(int param_n, int param_mode) {
+
+	int failed = 0;
+
+	MSMatrix<> mat(param_n, param_mode == MS_MODE_ASSOCIATIVE, param_mode != MS_MODE_NORMAL);
+
+	ThreadPool pool(1);
+	RetentionBuffers buffers(param_n, pool.getThreadCount());
+
+	RetentionOptions options;
+	options.conflict_neighbourhood = false;
+	options.bounds = true;
+	options.delta_cache = true;
+	options.constructive_restarts = true;
+	options.magic_moves = false;
+	options.compound_ratio = 0.0;
+
+	for(int search = 0; search < SEARCH_ALGORITHMS; ++search) {
+		ostringstream out;
+
+		mat.seedRandom(TEST_SEED + param_n * 3 + param_mode);
+
+		//No construction of this dimension and mode
+		if(!mat.constructiveRestart())
+			return 0;
+
+		int constructed = mat.retention();
+
+		int ret;
+		AcceptanceRule *rule = createAcceptanceRule(search, 0);
+		if(rule) {
+			ret = localSearchRetention(&mat, rule, TEST_ITERATIONS, TEST_RESTART_CHANCE, false, true, 0.0, (const AnytimeSettings*)0, &buffers, out);
+			delete rule;
+		} else
+			ret = tabuRetention(&mat, (MSMatrix<>**)0, &pool, (const IslandSettings*)0, (2 * param_n) / 3, TEST_ITERATIONS, TEST_RESTART_CHANCE, false, &options, (const CheckpointSettings*)0, (const TelemetrySettings*)0, (const AnytimeSettings*)0, (const ArchiveSettings*)0, &buffers, out);
+
+		if(ret < constructed || mat.violation() != 0 || mat.retention() != ret) {
+			cout << "FAILED constructive start: n=" << param_n << " mode=" << param_mode << " search=" << searchName(search)
+				<< " constructed=" << constructed << " best=" << ret << endl;
+			++failed;
+		}
+	}
+
+	return failed;
+
+}
+
+int main() {
+
+	int failed = 0;
+
+	for(int n = 3; n <= 12; ++n) {
+		for(int mode = MS_MODE_NORMAL; mode <= MS_MODE_SEMI_MAGIC; ++mode) {
+			failed += testIncrementalDimension(n, mode);
+			failed += testConstructiveStart(n, mode);
+		}
+	}
+
+	if(failed > 0) {
+		cout << failed << " checks failed." << endl;
+		return 1;
+	}
+
+	cout << "All checks passed." << endl;
+	return 0;
+
+}